@@ -0,0 +1,301 @@
+///////////////////////////////////////////////////////////////////////////////
+// BakedScene.cpp
+// ==============
+// static scene merged into one vertex/index buffer in world space
+///////////////////////////////////////////////////////////////////////////////
+
+#define GL_SILENCE_DEPRECATION // silence deprecation warnings
+
+#ifdef _WIN32
+#include <windows.h>    // include windows.h to avoid thousands of compile errors even though this class is not depending on Windows
+#endif
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include "BakedScene.h"
+
+// constants //////////////////////////////////////////////////////////////////
+const float EPSILON = 0.000001f;
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor
+///////////////////////////////////////////////////////////////////////////////
+BakedScene::BakedScene() : count(0), threadCount(0), dirty(true), bakeCount(0), bakeTime(0)
+{
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// set # of threads to bake with, 0 for all hardware threads
+// The result is identical regardless of the thread count.
+///////////////////////////////////////////////////////////////////////////////
+void BakedScene::setThreadCount(int count)
+{
+    threadCount = (count < 0) ? 1 : count;
+}
+
+int BakedScene::getWorkerCount() const
+{
+    if(threadCount > 0)
+        return threadCount;
+
+    int count = (int)std::thread::hardware_concurrency();
+    return (count > 0) ? count : 1;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// start over, the parts are kept to detect changes
+///////////////////////////////////////////////////////////////////////////////
+void BakedScene::clear()
+{
+    count = 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// append a part, the scene is re-baked if it differs from the part at the
+// same position last time
+// Only the float vertex format can be baked, compact meshes are skipped.
+///////////////////////////////////////////////////////////////////////////////
+void BakedScene::add(const IcosphereHandle& mesh, const vec3& position, const quat& rotation, const vec3& scale,
+                     const float color[4])
+{
+    addPart(mesh, position, rotation, scale, color);
+}
+
+void BakedScene::add(const CylinderHandle& mesh, const vec3& position, const quat& rotation, const vec3& scale,
+                     const float color[4])
+{
+    addPart(mesh, position, rotation, scale, color);
+}
+
+template<class Mesh>
+void BakedScene::addPart(const std::shared_ptr<const Mesh>& mesh, const vec3& position, const quat& rotation,
+                         const vec3& scale, const float color[4])
+{
+    if(!mesh || mesh->getVertexFormat() != VERTEX_FLOAT)
+        return;
+
+    Part part;
+    part.owner = mesh;
+    part.vertices = mesh->getInterleavedVertices();
+    part.indices = mesh->getIndexData();
+    part.shortIndex = (mesh->getIndexElementSize() == sizeof(unsigned short));
+    part.vertexCount = mesh->getInterleavedVertexCount();
+    part.indexCount = mesh->getIndexCount();
+    part.flat = mesh->getWelded() && !mesh->getSmooth();
+    position.store(part.position);
+    scale.store(part.scale);
+    part.rotation[0] = rotation.x;
+    part.rotation[1] = rotation.y;
+    part.rotation[2] = rotation.z;
+    part.rotation[3] = rotation.w;
+    for(int i = 0; i < 4; ++i)
+    {
+        float c = color[i] < 0 ? 0 : (color[i] > 1 ? 1 : color[i]);
+        part.color[i] = (unsigned char)(c * 255 + 0.5f);
+    }
+
+    if(count < parts.size())
+    {
+        if(!isSamePart(parts[count], part))
+        {
+            parts[count] = part;
+            dirty = true;
+        }
+    }
+    else
+    {
+        parts.push_back(part);
+        dirty = true;
+    }
+    ++count;
+}
+
+bool BakedScene::isSamePart(const Part& a, const Part& b)
+{
+    return a.owner == b.owner &&
+           memcmp(a.position, b.position, sizeof(a.position)) == 0 &&
+           memcmp(a.rotation, b.rotation, sizeof(a.rotation)) == 0 &&
+           memcmp(a.scale, b.scale, sizeof(a.scale)) == 0 &&
+           memcmp(a.color, b.color, sizeof(a.color)) == 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// merge all parts if they changed since the last bake
+// The offsets of each part come from a serial prefix sum, then the parts are
+// transformed on worker threads straight into their ranges; the calling
+// thread is one of the workers.
+///////////////////////////////////////////////////////////////////////////////
+void BakedScene::bake()
+{
+    // fewer parts than last time is a change too
+    if(!dirty && count == parts.size())
+        return;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    parts.resize(count);                    // drop parts not added since clear()
+
+    // a flat part has 1 vertex per index after unwelding
+    std::vector<std::size_t> vertexOffsets(count + 1);
+    std::vector<std::size_t> indexOffsets(count + 1);
+    vertexOffsets[0] = indexOffsets[0] = 0;
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        const Part& part = parts[i];
+        vertexOffsets[i + 1] = vertexOffsets[i] + (part.flat ? part.indexCount : part.vertexCount);
+        indexOffsets[i + 1] = indexOffsets[i] + part.indexCount;
+    }
+
+    // clear memory of prev arrays, then allocate exact sizes
+    std::vector<Vertex>(vertexOffsets[count]).swap(vertices);
+    std::vector<unsigned int>(indexOffsets[count]).swap(indices);
+
+    std::atomic<std::size_t> nextPart(0);
+    auto bakeParts = [&]()
+    {
+        std::size_t i;
+        while((i = nextPart++) < count)
+        {
+            bakePart(parts[i], vertices.data() + vertexOffsets[i], indices.data() + indexOffsets[i],
+                     (unsigned int)vertexOffsets[i]);
+        }
+    };
+
+    int workerCount = (int)std::min<std::size_t>(getWorkerCount(), count > 0 ? count : 1);
+    std::vector<std::thread> workers;
+    for(int i = 1; i < workerCount; ++i)
+        workers.push_back(std::thread(bakeParts));
+    bakeParts();
+    for(std::size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    buffers.invalidate();
+    dirty = false;
+    ++bakeCount;
+    bakeTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// transform a part into world space
+// position = rotate(scale * v) + translation, and the normal goes through the
+// inverse transpose, rotate(n / scale), then normalized. A flat part gets
+// the normal of the last corner (the provoking vertex of GL_FLAT) on all 3
+// corners of each triangle.
+///////////////////////////////////////////////////////////////////////////////
+void BakedScene::bakePart(const Part& part, Vertex* dstVertices, unsigned int* dstIndices,
+                          unsigned int baseVertex) const
+{
+    const vec3 position(part.position);
+    const vec3 scale(part.scale);
+    const vec3 inverseScale(1 / std::max(scale.x, EPSILON), 1 / std::max(scale.y, EPSILON),
+                            1 / std::max(scale.z, EPSILON));
+    const quat rotation(part.rotation[0], part.rotation[1], part.rotation[2], part.rotation[3]);
+    const mat4 matrix = mat4::compose(position, rotation, scale);
+    const mat4 normalMatrix = mat4::compose(vec3(), rotation, inverseScale);
+
+    const unsigned short* shortIndices = (const unsigned short*)part.indices;
+    const unsigned int* longIndices = (const unsigned int*)part.indices;
+
+    if(!part.flat)
+    {
+        for(unsigned int i = 0; i < part.vertexCount; ++i)
+        {
+            const float* src = part.vertices + i * 8;
+            Vertex& dst = dstVertices[i];
+            transformPoint(matrix, vec3(src)).store(dst.position);
+            normalize(transformVector(normalMatrix, vec3(src + 3))).store(dst.normal);
+            memcpy(dst.color, part.color, sizeof(dst.color));
+        }
+        for(unsigned int i = 0; i < part.indexCount; ++i)
+            dstIndices[i] = baseVertex + (part.shortIndex ? shortIndices[i] : longIndices[i]);
+        return;
+    }
+
+    for(unsigned int i = 0; i < part.indexCount; i += 3)
+    {
+        unsigned int last = part.shortIndex ? shortIndices[i + 2] : longIndices[i + 2];
+        vec3 normal = normalize(transformVector(normalMatrix, vec3(part.vertices + last * 8 + 3)));
+        for(int k = 0; k < 3; ++k)
+        {
+            unsigned int index = part.shortIndex ? shortIndices[i + k] : longIndices[i + k];
+            Vertex& dst = dstVertices[i + k];
+            transformPoint(matrix, vec3(part.vertices + index * 8)).store(dst.position);
+            normal.store(dst.normal);
+            memcpy(dst.color, part.color, sizeof(dst.color));
+            dstIndices[i + k] = baseVertex + i + k;
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// draw all parts with one call, from buffer objects if available
+// The color array drives the material through GL_COLOR_MATERIAL. It leaves
+// the current color undefined, so it is restored.
+///////////////////////////////////////////////////////////////////////////////
+void BakedScene::draw()
+{
+    bake();
+    if(indices.empty())
+        return;
+
+    bool buffered = buffers.bindVertices(vertices.data(), getVertexSize()) &&
+                    buffers.bindIndices(indices.data(), getIndexSize());
+    const char* base = buffered ? 0 : (const char*)&vertices[0];   // offsets if buffered
+
+    glPushAttrib(GL_CURRENT_BIT);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(Vertex), base + offsetof(Vertex, position));
+    glNormalPointer(GL_FLOAT, sizeof(Vertex), base + offsetof(Vertex, normal));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex), base + offsetof(Vertex, color));
+
+    glDrawElements(GL_TRIANGLES, getIndexCount(), GL_UNSIGNED_INT, buffered ? 0 : &indices[0]);
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    if(buffered)
+        MeshBuffers::unbind();
+    glPopAttrib();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// debug
+///////////////////////////////////////////////////////////////////////////////
+void BakedScene::printSelf() const
+{
+    std::cout << "===== Baked Scene =====\n"
+              << "    Part Count: " << count << "\n"
+              << "  Vertex Count: " << getVertexCount() << " (" << getVertexSize() << " bytes)\n"
+              << "   Index Count: " << getIndexCount() << " (" << getIndexSize() << " bytes)\n"
+              << "Triangle Count: " << getTriangleCount() << "\n"
+              << "    Bake Count: " << bakeCount << "\n"
+              << "     Bake Time: " << bakeTime << " ms" << std::endl;
+}
@@ -0,0 +1,104 @@
+///////////////////////////////////////////////////////////////////////////////
+// BakedScene.h
+// ============
+// static scene merged into one vertex/index buffer in world space
+// Each part is a shared unit mesh with a position, rotation, scale and
+// color, as in InstanceBatch. bake() transforms all parts on worker threads
+// into one interleaved array of position, normal and color (28 bytes per
+// vertex) and one 32-bit index array, and draw() is one glDrawElements().
+// Welded flat meshes are unwelded with the face normal on each corner,
+// so flat and smooth parts share the same smooth shade model.
+// Fill the parts with clear() then add() once, and again whenever they may
+// have changed. The scene is re-baked only if a part differs from last time.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef GEOMETRY_BAKED_SCENE_H
+#define GEOMETRY_BAKED_SCENE_H
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include "Math3d.h"
+#include "MeshBuffers.h"
+#include "MeshRegistry.h"
+
+class BakedScene
+{
+public:
+    BakedScene();
+
+    int getThreadCount() const              { return threadCount; }
+    void setThreadCount(int count);         // 0 = all hardware threads
+
+    // the unit mesh is scaled, rotated and then moved to position
+    void clear();                           // keep parts to compare with
+    void add(const IcosphereHandle& mesh, const vec3& position, const quat& rotation, const vec3& scale,
+             const float color[4]);
+    void add(const CylinderHandle& mesh, const vec3& position, const quat& rotation, const vec3& scale,
+             const float color[4]);
+    int getPartCount() const                { return (int)count; }
+
+    // merge the parts now if they changed, draw() does it if not called
+    void bake();
+    bool isBaked() const                    { return !dirty; }
+    unsigned int getBakeCount() const       { return bakeCount; }
+    double getBakeTime() const              { return bakeTime; }       // ms of the last bake
+
+    // merged buffers
+    unsigned int getVertexCount() const     { return (unsigned int)vertices.size(); }
+    unsigned int getIndexCount() const      { return (unsigned int)indices.size(); }
+    unsigned int getTriangleCount() const   { return getIndexCount() / 3; }
+    std::size_t getVertexSize() const       { return vertices.size() * sizeof(Vertex); }       // # of bytes
+    std::size_t getIndexSize() const        { return indices.size() * sizeof(unsigned int); }
+
+    // draw all parts with one call, bake first if needed
+    void draw();
+    unsigned int getUploadCount() const     { return buffers.getUploadCount(); }
+    void releaseBuffers()                   { buffers.release(); }    // GL context must be current
+
+    // debug
+    void printSelf() const;
+
+private:
+    struct Vertex
+    {
+        float position[3];
+        float normal[3];
+        unsigned char color[4];
+    };
+
+    // a unit mesh and its transform, the owner keeps the mesh alive
+    struct Part
+    {
+        std::shared_ptr<const void> owner;
+        const float* vertices;              // interleaved V/N/T, 32 bytes
+        const void* indices;
+        bool shortIndex;                    // 16-bit indices
+        unsigned int vertexCount;
+        unsigned int indexCount;
+        bool flat;                          // welded flat shading, unweld it
+        float position[3];
+        float rotation[4];
+        float scale[3];
+        unsigned char color[4];
+    };
+
+    template<class Mesh>
+    void addPart(const std::shared_ptr<const Mesh>& mesh, const vec3& position, const quat& rotation,
+                 const vec3& scale, const float color[4]);
+    void bakePart(const Part& part, Vertex* dstVertices, unsigned int* dstIndices, unsigned int baseVertex) const;
+    static bool isSamePart(const Part& a, const Part& b);
+    int getWorkerCount() const;
+
+    std::vector<Part> parts;                // may be longer than count
+    std::size_t count;                      // # of parts added since clear()
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    MeshBuffers buffers;
+    int threadCount;
+    bool dirty;                             // parts changed since last bake
+    unsigned int bakeCount;
+    double bakeTime;
+};
+
+#endif
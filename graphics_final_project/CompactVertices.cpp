@@ -0,0 +1,178 @@
+///////////////////////////////////////////////////////////////////////////////
+// CompactVertices.cpp
+// ===================
+// quantized interleaved vertex array: 16 bytes per vertex
+///////////////////////////////////////////////////////////////////////////////
+
+#define GL_SILENCE_DEPRECATION // silence deprecation warnings
+
+#ifdef _WIN32
+#include <windows.h>    // include windows.h to avoid thousands of compile errors even though this class is not depending on Windows
+#endif
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+#include <cmath>
+#include "CompactVertices.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+const float SHORT_MAX = 32767.0f;
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// convert a float in [-1, 1] to int16
+///////////////////////////////////////////////////////////////////////////////
+static short quantize(float f)
+{
+    if(f > 1.0f)
+        f = 1.0f;
+    else if(f < -1.0f)
+        f = -1.0f;
+    return (short)lroundf(f * SHORT_MAX);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor
+///////////////////////////////////////////////////////////////////////////////
+CompactVertices::CompactVertices()
+{
+    offset[0] = offset[1] = offset[2] = 0;
+    scales[0] = scales[1] = scales[2] = 1;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// quantize interleaved float V/N/T
+///////////////////////////////////////////////////////////////////////////////
+void CompactVertices::build(const float* interleaved, std::size_t count)
+{
+    std::vector<short>(count * 8).swap(data);
+    if(count == 0)
+        return;
+
+    // bounding box
+    float minV[3], maxV[3], half[3];
+    std::size_t i;
+    int j;
+    for(j = 0; j < 3; ++j)
+        minV[j] = maxV[j] = interleaved[j];
+    for(i = 1; i < count; ++i)
+    {
+        const float* v = &interleaved[i * 8];
+        for(j = 0; j < 3; ++j)
+        {
+            if(v[j] < minV[j]) minV[j] = v[j];
+            if(v[j] > maxV[j]) maxV[j] = v[j];
+        }
+    }
+    for(j = 0; j < 3; ++j)
+    {
+        offset[j] = (minV[j] + maxV[j]) * 0.5f;
+        half[j] = (maxV[j] - minV[j]) * 0.5f;
+        if(half[j] <= 0)
+            half[j] = 1.0f;     // flat along this axis
+        scales[j] = half[j] / SHORT_MAX;
+    }
+
+    short* dst = &data[0];
+    for(i = 0; i < count; ++i, dst += 8)
+    {
+        const float* v = &interleaved[i * 8];
+
+        // position relative to the box
+        dst[0] = quantize((v[0] - offset[0]) / half[0]);
+        dst[1] = quantize((v[1] - offset[1]) / half[1]);
+        dst[2] = quantize((v[2] - offset[2]) / half[2]);
+
+        // normal pre-scaled by the box, the box scale divides it back
+        float nx = v[3] * half[0];
+        float ny = v[4] * half[1];
+        float nz = v[5] * half[2];
+        float length = sqrtf(nx * nx + ny * ny + nz * nz);
+        float lengthInv = (length > 0) ? 1.0f / length : 0;
+        dst[3] = quantize(nx * lengthInv);
+        dst[4] = quantize(ny * lengthInv);
+        dst[5] = quantize(nz * lengthInv);
+
+        dst[6] = quantize(v[6]);
+        dst[7] = quantize(v[7]);
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// dealloc
+///////////////////////////////////////////////////////////////////////////////
+void CompactVertices::clear()
+{
+    std::vector<short>().swap(data);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// scale positions uniformly, only the decode transform changes
+///////////////////////////////////////////////////////////////////////////////
+void CompactVertices::scale(float s)
+{
+    for(int i = 0; i < 3; ++i)
+    {
+        offset[i] *= s;
+        scales[i] *= s;
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// set vertex arrays with decode transforms
+// OpenGL RC must be set before calling it, and endDraw() must follow
+///////////////////////////////////////////////////////////////////////////////
+void CompactVertices::beginDraw(bool buffered) const
+{
+    glPushAttrib(GL_ENABLE_BIT | GL_TRANSFORM_BIT);
+    glEnable(GL_NORMALIZE);
+
+    // texcoord: 32767 = 1.0
+    glMatrixMode(GL_TEXTURE);
+    glPushMatrix();
+    glScalef(1 / SHORT_MAX, 1 / SHORT_MAX, 1);
+
+    // position: box offset and scale
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glTranslatef(offset[0], offset[1], offset[2]);
+    glScalef(scales[0], scales[1], scales[2]);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    const short* base = buffered ? 0 : &data[0];   // offsets if buffered
+    glVertexPointer(3, GL_SHORT, getStride(), base);
+    glNormalPointer(GL_SHORT, getStride(), base + 3);
+    glTexCoordPointer(2, GL_SHORT, getStride(), base + 6);
+}
+
+void CompactVertices::endDraw() const
+{
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+    glMatrixMode(GL_TEXTURE);
+    glPopMatrix();
+    glPopAttrib();  // restore matrix mode and GL_NORMALIZE
+}
@@ -0,0 +1,57 @@
+///////////////////////////////////////////////////////////////////////////////
+// CompactVertices.h
+// =================
+// quantized interleaved vertex array: 16 bytes per vertex
+// position:  3 x int16, normalized to the bounding box of the primitive
+// normal:    3 x snorm16
+// texcoord:  2 x int16, 1.0 = 32767
+// It is decoded by the fixed-function pipeline, so the bounding box is
+// applied with the modelview matrix and the texcoord scale with the texture
+// matrix. The normals are stored pre-scaled by the box extents, so they are
+// correct after the inverse-transpose of the box scale and GL_NORMALIZE.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef GEOMETRY_COMPACT_VERTICES_H
+#define GEOMETRY_COMPACT_VERTICES_H
+
+#include <vector>
+#include <cstddef>
+
+// layout of interleaved vertex array
+enum VertexFormat
+{
+    VERTEX_FLOAT = 0,                       // V/N/T in float, 32 bytes
+    VERTEX_COMPACT                          // V/N/T in int16, 16 bytes
+};
+
+class CompactVertices
+{
+public:
+    CompactVertices();
+
+    // quantize interleaved float V/N/T (8 floats per vertex)
+    void build(const float* interleaved, std::size_t count);
+    void clear();
+
+    // scale positions uniformly without re-quantizing (e.g. new radius)
+    void scale(float s);
+
+    std::size_t getCount() const            { return data.size() / 8; }
+    std::size_t getSize() const             { return data.size() * sizeof(short); }   // # of bytes
+    int getStride() const                   { return 16; }
+    const short* getData() const            { return data.data(); }
+    const float* getOffset() const          { return offset; }      // center of bounding box
+    const float* getScale() const           { return scales; }      // object units per position step
+
+    // enable vertex arrays and decode transforms, then restore
+    // buffered: the data is in the bound GL_ARRAY_BUFFER, not in client memory
+    void beginDraw(bool buffered=false) const;
+    void endDraw() const;
+
+private:
+    std::vector<short> data;                // x,y,z, nx,ny,nz, s,t
+    float offset[3];
+    float scales[3];
+};
+
+#endif
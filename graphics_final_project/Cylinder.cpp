@@ -14,6 +14,8 @@
 #include <iostream>
 #include <iomanip>
 #include <cmath>
+#include <map>
+#include <mutex>
 #include "Cylinder.h"
 
 
@@ -22,15 +24,41 @@
 const int MIN_SECTOR_COUNT = 3;
 const int MIN_STACK_COUNT  = 1;
 
+// unit circle rings shared by all cylinders, keyed by sector count
+// Rings are never erased, so the pointers to them stay valid. They are
+// function statics, so cylinders built by global objects find them ready.
+namespace
+{
+    std::map<int, std::vector<float> >& getUnitCircleRings()
+    {
+        static std::map<int, std::vector<float> > rings;
+        return rings;
+    }
+
+    std::mutex& getUnitCircleMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+}
+
 
 
 ///////////////////////////////////////////////////////////////////////////////
 // ctor
 ///////////////////////////////////////////////////////////////////////////////
 Cylinder::Cylinder(float baseRadius, float topRadius, float height, int sectors,
-                   int stacks, bool smooth) : interleavedStride(32)
+                   int stacks, bool smooth, bool build) : unitCircleVertices(0), shortIndex(false), interleavedStride(32),
+                   vertexFormat(VERTEX_FLOAT), optimized(false),
+                   welded(false), flatVertexCount(0), singleStorage(false), strut(false),
+                   baseHidden(true), topHidden(true), baseTrim(0), topTrim(0), dirty(true), moved(false),
+                   rebuildCount(0), updateCount(0)
 {
+    cacheStatsBefore.acmr = cacheStatsBefore.atvr = 0;
+    cacheStatsAfter = cacheStatsBefore;
     set(baseRadius, topRadius, height, sectors, stacks, smooth);
+    if(build)
+        commit();   // build now, a const object cannot be built later
 }
 
 
@@ -41,53 +69,58 @@ Cylinder::Cylinder(float baseRadius, float topRadius, float height, int sectors,
 void Cylinder::set(float baseRadius, float topRadius, float height, int sectors,
                    int stacks, bool smooth)
 {
+    if(sectors < MIN_SECTOR_COUNT)
+        sectors = MIN_SECTOR_COUNT;
+    if(stacks < MIN_STACK_COUNT)
+        stacks = MIN_STACK_COUNT;
+    this->requestedStackCount = stacks;     // restored when strut mode is off
+    if(strut)
+        stacks = MIN_STACK_COUNT;   // a straight strut needs no more
+
+    // same topology only needs to move vertices, otherwise rebuild on next access
+    if(!dirty)
+    {
+        if(this->sectorCount != sectors || this->stackCount != stacks || this->smooth != smooth)
+            dirty = true;
+        else if(this->baseRadius != baseRadius || this->topRadius != topRadius || this->height != height)
+            moved = true;
+    }
+
     this->baseRadius = baseRadius;
     this->topRadius = topRadius;
     this->height = height;
     this->sectorCount = sectors;
-    if(sectors < MIN_SECTOR_COUNT)
-        this->sectorCount = MIN_SECTOR_COUNT;
     this->stackCount = stacks;
-    if(stacks < MIN_STACK_COUNT)
-        this->stackCount = MIN_STACK_COUNT;
     this->smooth = smooth;
-
-    // generate unit circle vertices first
-    buildUnitCircleVertices();
-
-    if(smooth)
-        buildVerticesSmooth();
-    else
-        buildVerticesFlat();
 }
 
 void Cylinder::setBaseRadius(float radius)
 {
     if(this->baseRadius != radius)
-        set(radius, topRadius, height, sectorCount, stackCount, smooth);
+        set(radius, topRadius, height, sectorCount, requestedStackCount, smooth);
 }
 
 void Cylinder::setTopRadius(float radius)
 {
     if(this->topRadius != radius)
-        set(baseRadius, radius, height, sectorCount, stackCount, smooth);
+        set(baseRadius, radius, height, sectorCount, requestedStackCount, smooth);
 }
 
 void Cylinder::setHeight(float height)
 {
     if(this->height != height)
-        set(baseRadius, topRadius, height, sectorCount, stackCount, smooth);
+        set(baseRadius, topRadius, height, sectorCount, requestedStackCount, smooth);
 }
 
 void Cylinder::setSectorCount(int sectors)
 {
     if(this->sectorCount != sectors)
-        set(baseRadius, topRadius, height, sectors, stackCount, smooth);
+        set(baseRadius, topRadius, height, sectors, requestedStackCount, smooth);
 }
 
 void Cylinder::setStackCount(int stacks)
 {
-    if(this->stackCount != stacks)
+    if(this->requestedStackCount != stacks)
         set(baseRadius, topRadius, height, sectorCount, stacks, smooth);
 }
 
@@ -97,10 +130,186 @@ void Cylinder::setSmooth(bool smooth)
         return;
 
     this->smooth = smooth;
-    if(smooth)
-        buildVerticesSmooth();
+    dirty = true;       // rebuild on next access
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// strut mode: the side of a straight strut is linear along the length, so a
+// single stack has the same shape; caps flagged hidden are not built and the
+// ends can be trimmed, e.g. where they are buried in node spheres
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::setStrut(bool strut)
+{
+    if(this->strut == strut)
+        return;
+
+    this->strut = strut;
+    set(baseRadius, topRadius, height, sectorCount, requestedStackCount, smooth);
+    dirty = true;       // caps may change too
+}
+
+void Cylinder::setHiddenCaps(bool base, bool top)
+{
+    if(this->baseHidden == base && this->topHidden == top)
+        return;
+
+    this->baseHidden = base;
+    this->topHidden = top;
+    if(strut)
+        dirty = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cut the length from each end along the side, the radii follow the taper
+// It moves vertices only, so it is updated in place if possible.
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::setTrim(float base, float top)
+{
+    if(this->baseTrim == base && this->topTrim == top)
+        return;
+
+    this->baseTrim = base;
+    this->topTrim = top;
+    if(strut && !dirty)
+        moved = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// trim length for an end in a node sphere of nodeRadius: the rim of the end
+// meets the sphere, so the end is hidden without a gap
+// Use the inscribed radius for a faceted sphere. Return 0 if the strut is
+// thicker than the node, then the cap cannot be hidden.
+///////////////////////////////////////////////////////////////////////////////
+float Cylinder::computeNodeTrim(float nodeRadius, float radius)
+{
+    if(radius >= nodeRadius)
+        return 0;
+    return sqrtf(nodeRadius * nodeRadius - radius * radius);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// select layout of interleaved vertices
+// VERTEX_COMPACT quantizes V/N/T to 16 bytes and frees the float array
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::setVertexFormat(VertexFormat format)
+{
+    if(this->vertexFormat == format)
+        return;
+
+    // convert now if built, otherwise the next rebuild does it
+    this->vertexFormat = format;
+    if(format == VERTEX_COMPACT)
+    {
+        if(!dirty)
+            buildCompactVertices();
+    }
     else
-        buildVerticesFlat();
+    {
+        compactVertices.clear();
+        interleavedStride = 32;
+        if(singleStorage)
+            dirty = true;   // nothing left to expand, rebuild on next access
+        else if(!dirty)
+            buildInterleavedVertices();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// enable/disable vertex cache optimization, rebuilt on next access
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::setOptimized(bool optimized)
+{
+    if(this->optimized == optimized)
+        return;
+
+    this->optimized = optimized;
+    dirty = true;       // rebuild on next access
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// use welded vertices for flat shading, rebuilt on next access
+// It has no effect on smooth shading.
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::setWelded(bool welded)
+{
+    if(this->welded == welded)
+        return;
+
+    this->welded = welded;
+    if(!smooth)
+        dirty = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// keep only the interleaved or compact array after build
+// Turning it off needs the separate arrays again, so rebuild on next access.
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::setSingleStorage(bool single)
+{
+    if(this->singleStorage == single)
+        return;
+
+    this->singleStorage = single;
+    if(single && !dirty)
+        clearAttribArrays();
+    else
+        dirty = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// rebuild vertices if any parameter has changed since the last build
+// Setters only mark the geometry dirty, so consecutive changes cost a single
+// rebuild. Accessors and draw functions call it if the caller did not.
+// If only radii/height have changed, the positions are updated in place.
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::commit()
+{
+    if(!dirty && moved && canUpdatePositions())
+    {
+        moved = false;
+        ++updateCount;
+        updatePositions();
+        return;
+    }
+
+    if(!dirty && !moved)
+        return;
+
+    dirty = moved = false;
+    ++rebuildCount;
+
+    // generate unit circle vertices first
+    buildUnitCircleVertices();
+
+    buildVertices();
+
+    // whole array is new
+    changedRanges.clear();
+    addChangedRange(0, getInterleavedVertexSize());
+    buffers.invalidate();
+}
+
+unsigned int Cylinder::getInterleavedVertexSize() const
+{
+    update();
+    if(vertexFormat == VERTEX_COMPACT)
+        return (unsigned int)compactVertices.getSize();
+    return (unsigned int)interleavedVertices.size() * sizeof(float);
+}
+
+unsigned int Cylinder::getVertexCount() const
+{
+    update();
+    if(vertexFormat == VERTEX_COMPACT)
+        return (unsigned int)compactVertices.getCount();
+    return (unsigned int)interleavedVertices.size() / 8;
+}
+
+unsigned int Cylinder::getMemorySize() const
+{
+    update();
+    return getVertexSize() + getNormalSize() + getTexCoordSize() + getInterleavedVertexSize() +
+           getIndexSize() + getLineIndexSize();
 }
 
 
@@ -110,6 +319,7 @@ void Cylinder::setSmooth(bool smooth)
 ///////////////////////////////////////////////////////////////////////////////
 void Cylinder::printSelf() const
 {
+    update();
     std::cout << "===== Cylinder =====\n"
               << "   Base Radius: " << baseRadius << "\n"
               << "    Top Radius: " << topRadius << "\n"
@@ -121,7 +331,24 @@ void Cylinder::printSelf() const
               << "   Index Count: " << getIndexCount() << "\n"
               << "  Vertex Count: " << getVertexCount() << "\n"
               << "  Normal Count: " << getNormalCount() << "\n"
-              << "TexCoord Count: " << getTexCoordCount() << std::endl;
+              << "TexCoord Count: " << getTexCoordCount() << "\n"
+              << "   Memory Size: " << getMemorySize() << " bytes\n"
+              << " Vertex Format: " << (vertexFormat == VERTEX_COMPACT ? "compact" : "float")
+              << " (" << interleavedStride << " bytes)" << std::endl;
+    if(isWelded())
+    {
+        std::cout << "  Welded Count: " << getVertexCount() << " (unwelded: " << flatVertexCount << ")" << std::endl;
+    }
+    if(strut)
+    {
+        std::cout << "  Strut Caps: " << (hasBase() ? "base " : "") << (hasTop() ? "top" : "") << "\n"
+                  << "  Strut Trim: " << baseTrim << ", " << topTrim << std::endl;
+    }
+    if(optimized)
+    {
+        std::cout << "   Cache ACMR: " << cacheStatsBefore.acmr << " -> " << cacheStatsAfter.acmr << "\n"
+                  << "   Cache ATVR: " << cacheStatsBefore.atvr << " -> " << cacheStatsAfter.atvr << std::endl;
+    }
 }
 
 
@@ -132,19 +359,30 @@ void Cylinder::printSelf() const
 ///////////////////////////////////////////////////////////////////////////////
 void Cylinder::draw() const
 {
-    // interleaved array
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glEnableClientState(GL_NORMAL_ARRAY);
-    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glVertexPointer(3, GL_FLOAT, interleavedStride, &interleavedVertices[0]);
-    glNormalPointer(GL_FLOAT, interleavedStride, &interleavedVertices[3]);
-    glTexCoordPointer(2, GL_FLOAT, interleavedStride, &interleavedVertices[6]);
+    bool buffered = beginDraw();
+
+    glDrawElements(GL_TRIANGLES, getIndexCount(), getIndexType(), buffered ? 0 : getIndexData());
+
+    endDraw(buffered);
+}
+
 
-    glDrawElements(GL_TRIANGLES, (unsigned int)indices.size(), GL_UNSIGNED_INT, indices.data());
 
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_NORMAL_ARRAY);
-    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+///////////////////////////////////////////////////////////////////////////////
+// bind and enable the interleaved array, from buffer objects if available
+// The caller draws triangles in between, once or per copy.
+///////////////////////////////////////////////////////////////////////////////
+bool Cylinder::beginDraw() const
+{
+    update();
+    bool buffered = bindBuffers(false);
+    enableVertexArrays(buffered);
+    return buffered;
+}
+
+void Cylinder::endDraw(bool buffered) const
+{
+    disableVertexArrays(buffered);
 }
 
 
@@ -154,19 +392,14 @@ void Cylinder::draw() const
 ///////////////////////////////////////////////////////////////////////////////
 void Cylinder::drawSide() const
 {
-    // interleaved array
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glEnableClientState(GL_NORMAL_ARRAY);
-    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glVertexPointer(3, GL_FLOAT, interleavedStride, &interleavedVertices[0]);
-    glNormalPointer(GL_FLOAT, interleavedStride, &interleavedVertices[3]);
-    glTexCoordPointer(2, GL_FLOAT, interleavedStride, &interleavedVertices[6]);
+    update();
+    // interleaved array, from buffer objects if available
+    bool buffered = bindBuffers(false);
+    enableVertexArrays(buffered);
 
-    glDrawElements(GL_TRIANGLES, baseIndex, GL_UNSIGNED_INT, indices.data());
+    glDrawElements(GL_TRIANGLES, baseIndex, getIndexType(), buffered ? 0 : getIndexData());
 
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_NORMAL_ARRAY);
-    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    disableVertexArrays(buffered);
 }
 
 
@@ -176,38 +409,95 @@ void Cylinder::drawSide() const
 ///////////////////////////////////////////////////////////////////////////////
 void Cylinder::drawBase() const
 {
-    // interleaved array
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glEnableClientState(GL_NORMAL_ARRAY);
-    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glVertexPointer(3, GL_FLOAT, interleavedStride, &interleavedVertices[0]);
-    glNormalPointer(GL_FLOAT, interleavedStride, &interleavedVertices[3]);
-    glTexCoordPointer(2, GL_FLOAT, interleavedStride, &interleavedVertices[6]);
+    update();
+    // interleaved array, from buffer objects if available
+    bool buffered = bindBuffers(false);
+    enableVertexArrays(buffered);
 
-    unsigned int indexCount = ((unsigned int)indices.size() - baseIndex) / 2;
-    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, &indices[baseIndex]);
+    const char* indices = buffered ? 0 : (const char*)getIndexData();  // offset if buffered
+    glDrawElements(GL_TRIANGLES, getBaseIndexCount(), getIndexType(), indices + baseIndex * getIndexElementSize());
 
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_NORMAL_ARRAY);
-    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    disableVertexArrays(buffered);
 }
 
 void Cylinder::drawTop() const
 {
-    // interleaved array
+    update();
+    // interleaved array, from buffer objects if available
+    bool buffered = bindBuffers(false);
+    enableVertexArrays(buffered);
+
+    const char* indices = buffered ? 0 : (const char*)getIndexData();  // offset if buffered
+    glDrawElements(GL_TRIANGLES, getTopIndexCount(), getIndexType(), indices + topIndex * getIndexElementSize());
+
+    disableVertexArrays(buffered);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// bind buffer objects of vertices and triangle (or line) indices, uploading
+// them first if they changed since the last draw
+// Return false if not available, then the pointers are client memory.
+///////////////////////////////////////////////////////////////////////////////
+bool Cylinder::bindBuffers(bool lines) const
+{
+    bool compact = (vertexFormat == VERTEX_COMPACT);
+    if(!buffers.bindVertices(compact ? (const void*)compactVertices.getData() : (const void*)interleavedVertices.data(),
+                             getInterleavedVertexSize()))
+        return false;
+
+    if(lines)
+        return buffers.bindLineIndices(getLineIndexData(), getLineIndexSize());
+    return buffers.bindIndices(getIndexData(), getIndexSize());
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// enable and set V/N/T arrays of the current vertex format
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::enableVertexArrays(bool buffered) const
+{
+    // welded flat mesh has the face normal on the last vertex of triangle only
+    if(isWelded())
+    {
+        glPushAttrib(GL_LIGHTING_BIT);
+        glShadeModel(GL_FLAT);
+    }
+
+    if(vertexFormat == VERTEX_COMPACT)
+    {
+        compactVertices.beginDraw(buffered);
+        return;
+    }
+
+    const float* base = buffered ? 0 : &interleavedVertices[0];   // offsets if buffered
     glEnableClientState(GL_VERTEX_ARRAY);
     glEnableClientState(GL_NORMAL_ARRAY);
     glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glVertexPointer(3, GL_FLOAT, interleavedStride, &interleavedVertices[0]);
-    glNormalPointer(GL_FLOAT, interleavedStride, &interleavedVertices[3]);
-    glTexCoordPointer(2, GL_FLOAT, interleavedStride, &interleavedVertices[6]);
+    glVertexPointer(3, GL_FLOAT, interleavedStride, base);
+    glNormalPointer(GL_FLOAT, interleavedStride, base + 3);
+    glTexCoordPointer(2, GL_FLOAT, interleavedStride, base + 6);
+}
 
-    unsigned int indexCount = ((unsigned int)indices.size() - baseIndex) / 2;
-    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, &indices[topIndex]);
+void Cylinder::disableVertexArrays(bool buffered) const
+{
+    if(vertexFormat == VERTEX_COMPACT)
+    {
+        compactVertices.endDraw();
+    }
+    else
+    {
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    }
+    if(buffered)
+        MeshBuffers::unbind();
 
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_NORMAL_ARRAY);
-    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    if(isWelded())
+        glPopAttrib();
 }
 
 
@@ -218,6 +508,7 @@ void Cylinder::drawTop() const
 ///////////////////////////////////////////////////////////////////////////////
 void Cylinder::drawLines(const float lineColor[4]) const
 {
+    update();
     // set line colour
     glColor4fv(lineColor);
     glMaterialfv(GL_FRONT, GL_DIFFUSE,   lineColor);
@@ -225,18 +516,47 @@ void Cylinder::drawLines(const float lineColor[4]) const
     // draw lines with VA
     glDisable(GL_LIGHTING);
     glDisable(GL_TEXTURE_2D);
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glVertexPointer(3, GL_FLOAT, 0, vertices.data());
-
-    glDrawElements(GL_LINES, (unsigned int)lineIndices.size(), GL_UNSIGNED_INT, lineIndices.data());
-
-    glDisableClientState(GL_VERTEX_ARRAY);
+    bool buffered = beginDrawLines();
+    glDrawElements(GL_LINES, getLineIndexCount(), getIndexType(), buffered ? 0 : getLineIndexData());
+    endDrawLines(buffered);
     glEnable(GL_LIGHTING);
     glEnable(GL_TEXTURE_2D);
 }
 
 
 
+///////////////////////////////////////////////////////////////////////////////
+// bind the line indices and enable the vertex array only
+// The caller draws GL_LINES in between with lighting off, once or per copy.
+///////////////////////////////////////////////////////////////////////////////
+bool Cylinder::beginDrawLines() const
+{
+    update();
+    bool buffered = bindBuffers(true);
+    if(vertexFormat == VERTEX_COMPACT)
+    {
+        compactVertices.beginDraw(buffered);
+    }
+    else
+    {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(3, GL_FLOAT, interleavedStride, buffered ? 0 : &interleavedVertices[0]);
+    }
+    return buffered;
+}
+
+void Cylinder::endDrawLines(bool buffered) const
+{
+    if(vertexFormat == VERTEX_COMPACT)
+        compactVertices.endDraw();
+    else
+        glDisableClientState(GL_VERTEX_ARRAY);
+    if(buffered)
+        MeshBuffers::unbind();
+}
+
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // draw a cylinder surfaces and lines on top of it
 // the caller must set the line width before call this
@@ -254,6 +574,185 @@ void Cylinder::drawWithLines(const float lineColor[4]) const
 
 
 
+///////////////////////////////////////////////////////////////////////////////
+// positions can be updated in place if the vertex layout is as generated:
+// not reordered, welded or quantized
+///////////////////////////////////////////////////////////////////////////////
+bool Cylinder::canUpdatePositions() const
+{
+    return !optimized && !isWelded() && vertexFormat == VERTEX_FLOAT;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// recompute positions and side normals with new radii/height, in the same
+// order as buildVerticesSmooth()/buildVerticesFlat() generate them
+// Texcoords and indices do not depend on them. Only the vertices that have
+// actually changed are written and reported as changed ranges.
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::updatePositions()
+{
+    float v[3], n[3];
+    std::size_t index = 0;                  // vertex index
+    int i, j, k;
+
+    // positions of side grid, same as the builders
+    float zBase, zTop, rBase, rTop;
+    getSideExtent(zBase, zTop, rBase, rTop);
+    int gridCount = (stackCount + 1) * (sectorCount + 1);
+    std::vector<float> grid(gridCount * 3);
+    for(i = 0, k = 0; i <= stackCount; ++i)
+    {
+        float z = zBase + (float)i / stackCount * (zTop - zBase);
+        float radius = rBase + (float)i / stackCount * (rTop - rBase);
+        for(j = 0; j <= sectorCount; ++j, k += 3)
+        {
+            grid[k]   = unitCircleVertices[j * 3] * radius;
+            grid[k+1] = unitCircleVertices[j * 3 + 1] * radius;
+            grid[k+2] = z;
+        }
+    }
+
+    // 1 if the vertex has changed
+    std::size_t vertexCount = interleavedVertices.size() / 8;
+    std::vector<unsigned char> changed(vertexCount, 0);
+
+    if(smooth)
+    {
+        const std::vector<float>& sideNormals = getSideNormals();
+        for(i = 0; i <= stackCount; ++i)
+        {
+            for(j = 0; j <= sectorCount; ++j, ++index)
+                changed[index] = setVertex(index, &grid[index * 3], &sideNormals[j * 3]);
+        }
+    }
+    else
+    {
+        // 4 vertices per quad: v1-v2-v3-v4, same face normal of v1-v3-v2
+        for(i = 0; i < stackCount; ++i)
+        {
+            int vi1 = i * (sectorCount + 1);
+            int vi2 = (i + 1) * (sectorCount + 1);
+            for(j = 0; j < sectorCount; ++j, ++vi1, ++vi2)
+            {
+                const float* v1 = &grid[vi1 * 3];
+                const float* v2 = &grid[vi2 * 3];
+                const float* v3 = &grid[(vi1 + 1) * 3];
+                const float* v4 = &grid[(vi2 + 1) * 3];
+                vec3 normal = computeFaceNormal(vec3(v1), vec3(v3), vec3(v2));
+                changed[index] = setVertex(index, v1, normal.data());  ++index;
+                changed[index] = setVertex(index, v2, normal.data());  ++index;
+                changed[index] = setVertex(index, v3, normal.data());  ++index;
+                changed[index] = setVertex(index, v4, normal.data());  ++index;
+            }
+        }
+    }
+
+    // base and top unless hidden: center then ring, normals do not change
+    for(int cap = 0; cap < 2; ++cap)
+    {
+        if(!(cap == 0 ? hasBase() : hasTop()))
+            continue;
+
+        float radius = (cap == 0) ? rBase : rTop;
+        n[0] = n[1] = 0;
+        n[2] = (cap == 0) ? -1.0f : 1.0f;
+        v[0] = v[1] = 0;
+        v[2] = (cap == 0) ? zBase : zTop;
+        changed[index] = setVertex(index, v, n);
+        ++index;
+        for(i = 0, k = 0; i < sectorCount; ++i, k += 3, ++index)
+        {
+            v[0] = unitCircleVertices[k] * radius;
+            v[1] = unitCircleVertices[k+1] * radius;
+            changed[index] = setVertex(index, v, n);
+        }
+    }
+
+    // report runs of changed vertices
+    for(std::size_t first = 0; first < vertexCount; ++first)
+    {
+        if(!changed[first])
+            continue;
+        std::size_t last = first;
+        while(last < vertexCount && changed[last])
+            ++last;
+        addChangedRange(first * interleavedStride, (last - first) * interleavedStride);
+        buffers.invalidateVertices(first * interleavedStride, (last - first) * interleavedStride);
+        first = last;
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// write position and normal of a vertex to interleaved and SoA arrays
+// return true if any of them is changed
+///////////////////////////////////////////////////////////////////////////////
+bool Cylinder::setVertex(std::size_t index, const float v[3], const float n[3])
+{
+    float* interleaved = &interleavedVertices[index * 8];
+    if(interleaved[0] == v[0] && interleaved[1] == v[1] && interleaved[2] == v[2] &&
+       interleaved[3] == n[0] && interleaved[4] == n[1] && interleaved[5] == n[2])
+        return false;
+
+    for(int i = 0; i < 3; ++i)
+    {
+        interleaved[i] = v[i];
+        interleaved[i + 3] = n[i];
+    }
+
+    // separate arrays are gone in single storage mode
+    if(!vertices.empty())
+    {
+        for(int i = 0; i < 3; ++i)
+        {
+            vertices[index * 3 + i] = v[i];
+            normals[index * 3 + i] = n[i];
+        }
+    }
+    return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// add a byte range to the changed ranges, merging overlapping/adjacent ones
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::addChangedRange(std::size_t offset, std::size_t size)
+{
+    if(size == 0)
+        return;
+
+    std::size_t end = offset + size;
+    std::vector<ByteRange> merged;
+    std::size_t i = 0, count = changedRanges.size();
+
+    // ranges before the new one
+    for(; i < count && changedRanges[i].offset + changedRanges[i].size < offset; ++i)
+        merged.push_back(changedRanges[i]);
+
+    // absorb ranges touching the new one
+    for(; i < count && changedRanges[i].offset <= end; ++i)
+    {
+        if(changedRanges[i].offset < offset)
+            offset = changedRanges[i].offset;
+        if(changedRanges[i].offset + changedRanges[i].size > end)
+            end = changedRanges[i].offset + changedRanges[i].size;
+    }
+    ByteRange range = { offset, end - offset };
+    merged.push_back(range);
+
+    // ranges after it
+    for(; i < count; ++i)
+        merged.push_back(changedRanges[i]);
+
+    changedRanges.swap(merged);
+}
+
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // dealloc vectors
 ///////////////////////////////////////////////////////////////////////////////
@@ -268,27 +767,58 @@ void Cylinder::clearArrays()
 
 
 
+///////////////////////////////////////////////////////////////////////////////
+// build vertices with current shading, then pack indices and vertices
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::buildVertices()
+{
+    if(smooth)
+        buildVerticesSmooth();
+    else
+        buildVerticesFlat();
+
+    if(isWelded())
+        weldVertices();
+    if(optimized)
+        optimizeVertices();
+    packIndices();
+    if(vertexFormat == VERTEX_COMPACT)
+        buildCompactVertices();
+    if(singleStorage)
+        clearAttribArrays();
+}
+
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // build vertices of cylinder with smooth shading
 // where v: sector angle (0 <= v <= 360)
 ///////////////////////////////////////////////////////////////////////////////
 void Cylinder::buildVerticesSmooth()
 {
-    // clear memory of prev arrays
+    // clear memory of prev arrays, then reserve exact sizes:
+    // side grid and caps of center + ring, 2 triangles per side quad and
+    // 1 per cap sector, 2 lines per side quad and the bottom ring
     clearArrays();
+    int capCount = hasBase() + hasTop();
+    reserveArrays((stackCount + 1) * (sectorCount + 1) + capCount * (sectorCount + 1),
+                  6 * sectorCount * stackCount + 3 * sectorCount * capCount,
+                  4 * sectorCount * stackCount + 2 * sectorCount);
 
     float x, y, z;                                  // vertex position
     //float s, t;                                     // texCoord
     float radius;                                   // radius for each stack
 
     // get normals for cylinder sides
-    std::vector<float> sideNormals = getSideNormals();
+    const std::vector<float>& sideNormals = getSideNormals();
 
     // put vertices of side cylinder to array by scaling unit circle
+    float zBase, zTop, rBase, rTop;
+    getSideExtent(zBase, zTop, rBase, rTop);
     for(int i = 0; i <= stackCount; ++i)
     {
-        z = -(height * 0.5f) + (float)i / stackCount * height;      // vertex position z
-        radius = baseRadius + (float)i / stackCount * (topRadius - baseRadius);     // lerp
+        z = zBase + (float)i / stackCount * (zTop - zBase);         // vertex position z
+        radius = rBase + (float)i / stackCount * (rTop - rBase);    // lerp
         float t = 1.0f - (float)i / stackCount;   // top-to-bottom
 
         for(int j = 0, k = 0; j <= sectorCount; ++j, k += 3)
@@ -301,39 +831,12 @@ void Cylinder::buildVerticesSmooth()
         }
     }
 
-    // remember where the base.top vertices start
-    unsigned int baseVertexIndex = (unsigned int)vertices.size() / 3;
-
-    // put vertices of base of cylinder
-    z = -height * 0.5f;
-    addVertex(0, 0, z);
-    addNormal(0, 0, -1);
-    addTexCoord(0.5f, 0.5f);
-    for(int i = 0, j = 0; i < sectorCount; ++i, j += 3)
-    {
-        x = unitCircleVertices[j];
-        y = unitCircleVertices[j+1];
-        addVertex(x * baseRadius, y * baseRadius, z);
-        addNormal(0, 0, -1);
-        addTexCoord(-x * 0.5f + 0.5f, -y * 0.5f + 0.5f);    // flip horizontal
-    }
-
-    // remember where the base vertices start
-    unsigned int topVertexIndex = (unsigned int)vertices.size() / 3;
-
-    // put vertices of top of cylinder
-    z = height * 0.5f;
-    addVertex(0, 0, z);
-    addNormal(0, 0, 1);
-    addTexCoord(0.5f, 0.5f);
-    for(int i = 0, j = 0; i < sectorCount; ++i, j += 3)
-    {
-        x = unitCircleVertices[j];
-        y = unitCircleVertices[j+1];
-        addVertex(x * topRadius, y * topRadius, z);
-        addNormal(0, 0, 1);
-        addTexCoord(x * 0.5f + 0.5f, -y * 0.5f + 0.5f);
-    }
+    // put vertices of base and top of cylinder unless hidden
+    unsigned int baseVertexIndex = 0, topVertexIndex = 0;
+    if(hasBase())
+        baseVertexIndex = addCapVertices(zBase, rBase, false);
+    if(hasTop())
+        topVertexIndex = addCapVertices(zTop, rTop, true);
 
     // put indices for sides
     unsigned int k1, k2;
@@ -362,28 +865,13 @@ void Cylinder::buildVerticesSmooth()
         }
     }
 
-    // remember where the base indices start
+    // remember where the base and top indices start
     baseIndex = (unsigned int)indices.size();
-
-    // put indices for base
-    for(int i = 0, k = baseVertexIndex + 1; i < sectorCount; ++i, ++k)
-    {
-        if(i < (sectorCount - 1))
-            addIndices(baseVertexIndex, k + 1, k);
-        else    // last triangle
-            addIndices(baseVertexIndex, baseVertexIndex + 1, k);
-    }
-
-    // remember where the base indices start
+    if(hasBase())
+        addCapIndices(baseVertexIndex, false);
     topIndex = (unsigned int)indices.size();
-
-    for(int i = 0, k = topVertexIndex + 1; i < sectorCount; ++i, ++k)
-    {
-        if(i < (sectorCount - 1))
-            addIndices(topVertexIndex, k, k + 1);
-        else
-            addIndices(topVertexIndex, k, topVertexIndex + 1);
-    }
+    if(hasTop())
+        addCapIndices(topVertexIndex, true);
 
     // generate interleaved vertex array as well
     buildInterleavedVertices();
@@ -403,6 +891,7 @@ void Cylinder::buildVerticesFlat()
         float x, y, z, s, t;
     };
     std::vector<Vertex> tmpVertices;
+    tmpVertices.reserve((stackCount + 1) * (sectorCount + 1));
 
     int i, j, k;    // indices
     float x, y, z, s, t, radius;
@@ -410,10 +899,12 @@ void Cylinder::buildVerticesFlat()
     // put tmp vertices of cylinder side to array by scaling unit circle
     //NOTE: start and end vertex positions are same, but texcoords are different
     //      so, add additional vertex at the end point
+    float zBase, zTop, rBase, rTop;
+    getSideExtent(zBase, zTop, rBase, rTop);
     for(i = 0; i <= stackCount; ++i)
     {
-        z = -(height * 0.5f) + (float)i / stackCount * height;      // vertex position z
-        radius = baseRadius + (float)i / stackCount * (topRadius - baseRadius);     // lerp
+        z = zBase + (float)i / stackCount * (zTop - zBase);         // vertex position z
+        radius = rBase + (float)i / stackCount * (rTop - rBase);    // lerp
         t = 1.0f - (float)i / stackCount;   // top-to-bottom
 
         for(j = 0, k = 0; j <= sectorCount; ++j, k += 3)
@@ -432,11 +923,16 @@ void Cylinder::buildVerticesFlat()
         }
     }
 
-    // clear memory of prev arrays
+    // clear memory of prev arrays, then reserve exact sizes:
+    // 4 vertices per side quad and caps of center + ring
     clearArrays();
+    int capCount = hasBase() + hasTop();
+    reserveArrays(4 * sectorCount * stackCount + capCount * (sectorCount + 1),
+                  6 * sectorCount * stackCount + 3 * sectorCount * capCount,
+                  4 * sectorCount * stackCount + 2 * sectorCount);
 
     Vertex v1, v2, v3, v4;      // 4 vertex positions v1, v2, v3, v4
-    std::vector<float> n;       // 1 face normal
+    vec3 n;                     // 1 face normal
     int vi1, vi2;               // indices
     int index = 0;
 
@@ -456,7 +952,7 @@ void Cylinder::buildVerticesFlat()
             v4 = tmpVertices[vi2 + 1];
 
             // compute a face normal of v1-v3-v2
-            n = computeFaceNormal(v1.x,v1.y,v1.z, v3.x,v3.y,v3.z, v2.x,v2.y,v2.z);
+            n = computeFaceNormal(vec3(v1.x, v1.y, v1.z), vec3(v3.x, v3.y, v3.z), vec3(v2.x, v2.y, v2.z));
 
             // put quad vertices: v1-v2-v3-v4
             addVertex(v1.x, v1.y, v1.z);
@@ -473,7 +969,7 @@ void Cylinder::buildVerticesFlat()
             // put normal
             for(k = 0; k < 4; ++k)  // same normals for all 4 vertices
             {
-                addNormal(n[0], n[1], n[2]);
+                addNormal(n.x, n.y, n.z);
             }
 
             // put indices of a quad
@@ -496,112 +992,267 @@ void Cylinder::buildVerticesFlat()
         }
     }
 
-    // remember where the base index starts
+    // put base and top of cylinder unless hidden
     baseIndex = (unsigned int)indices.size();
-    unsigned int baseVertexIndex = (unsigned int)vertices.size() / 3;
+    if(hasBase())
+        addCapIndices(addCapVertices(zBase, rBase, false), false);
+    topIndex = (unsigned int)indices.size();
+    if(hasTop())
+        addCapIndices(addCapVertices(zTop, rTop, true), true);
 
-    // put vertices of base of cylinder
-    z = -height * 0.5f;
-    addVertex(0, 0, z);
-    addNormal(0, 0, -1);
-    addTexCoord(0.5f, 0.5f);
-    for(i = 0, j = 0; i < sectorCount; ++i, j += 3)
+    // generate interleaved vertex array as well
+    buildInterleavedVertices();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// generate interleaved vertices: V/N/T
+// stride must be 32 bytes
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::buildInterleavedVertices()
+{
+    std::size_t count = vertices.size() / 3;
+    std::vector<float>(count * 8).swap(interleavedVertices);
+
+    float* dst = interleavedVertices.data();
+    for(std::size_t i = 0, j = 0; i < count * 3; i += 3, j += 2, dst += 8)
     {
-        x = unitCircleVertices[j];
-        y = unitCircleVertices[j+1];
-        addVertex(x * baseRadius, y * baseRadius, z);
-        addNormal(0, 0, -1);
-        addTexCoord(-x * 0.5f + 0.5f, -y * 0.5f + 0.5f); // flip horizontal
+        dst[0] = vertices[i];
+        dst[1] = vertices[i+1];
+        dst[2] = vertices[i+2];
+
+        dst[3] = normals[i];
+        dst[4] = normals[i+1];
+        dst[5] = normals[i+2];
+
+        dst[6] = texCoords[j];
+        dst[7] = texCoords[j+1];
     }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// share vertices of flat shading between triangles
+// Each triangle keeps its face normal on its provoking (last) vertex, which
+// GL_FLAT uses for the whole triangle, so the vertex count drops to about
+// the triangle count instead of 3 times of it.
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::weldVertices()
+{
+    flatVertexCount = (unsigned int)vertices.size() / 3;
+    std::vector<unsigned int> remap = MeshOptimizer::weldFlatVertices(vertices, normals, texCoords, indices);
+    MeshOptimizer::remapIndices(lineIndices, remap);
+    buildInterleavedVertices();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// reorder triangles for vertex cache, then renumber vertices for fetch
+// locality, and remap all attribute arrays and line indices accordingly
+// The side, base and top are reordered separately, so each range can still be
+// drawn by itself.
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::optimizeVertices()
+{
+    std::size_t vertexCount = vertices.size() / 3;
+    cacheStatsBefore = MeshOptimizer::analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+
+    MeshOptimizer::optimizeVertexCache(&indices[0], baseIndex, vertexCount);
+    MeshOptimizer::optimizeVertexCache(indices.data() + baseIndex, topIndex - baseIndex, vertexCount);
+    MeshOptimizer::optimizeVertexCache(indices.data() + topIndex, indices.size() - topIndex, vertexCount);
+    std::vector<unsigned int> remap = MeshOptimizer::optimizeVertexFetch(indices.data(), indices.size(), vertexCount);
+    MeshOptimizer::remapIndices(lineIndices, remap);
+    MeshOptimizer::remapAttribs(vertices, 3, remap);
+    MeshOptimizer::remapAttribs(normals, 3, remap);
+    MeshOptimizer::remapAttribs(texCoords, 2, remap);
+    buildInterleavedVertices();
+
+    cacheStatsAfter = MeshOptimizer::analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// store indices in 16 bits if all vertices are addressable, then free the
+// 32-bit arrays
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::packIndices()
+{
+    std::vector<unsigned short>().swap(shortIndices);
+    std::vector<unsigned short>().swap(shortLineIndices);
+    shortIndex = vertices.size() / 3 <= 65536;
+    if(!shortIndex)
+        return;
+
+    shortIndices.assign(indices.begin(), indices.end());
+    shortLineIndices.assign(lineIndices.begin(), lineIndices.end());
+    std::vector<unsigned int>().swap(indices);
+    std::vector<unsigned int>().swap(lineIndices);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// return GL type of indices
+///////////////////////////////////////////////////////////////////////////////
+unsigned int Cylinder::getIndexType() const
+{
+    update();
+    return shortIndex ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// quantize interleaved vertices to 16-byte records, then free the float array
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::buildCompactVertices()
+{
+    compactVertices.build(interleavedVertices.data(), interleavedVertices.size() / 8);
+    std::vector<float>().swap(interleavedVertices);
+    interleavedStride = compactVertices.getStride();
+    buffers.invalidate();
+}
+
 
-    // put indices for base
-    for(i = 0, k = baseVertexIndex + 1; i < sectorCount; ++i, ++k)
+
+///////////////////////////////////////////////////////////////////////////////
+// z and radius at the base and top ends of the side
+// They are -height/2 and +height/2 with base/top radius unless strut ends are
+// trimmed; the trims are clamped, so the ends never cross.
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::getSideExtent(float& zBase, float& zTop, float& rBase, float& rTop) const
+{
+    zBase = -(height * 0.5f);
+    zTop = height * 0.5f;
+    rBase = baseRadius;
+    rTop = topRadius;
+    if(!strut || (baseTrim <= 0 && topTrim <= 0) || height <= 0)
+        return;
+
+    float base = (baseTrim > 0) ? baseTrim : 0;
+    float top = (topTrim > 0) ? topTrim : 0;
+    if(base + top > height)
     {
-        if(i < sectorCount - 1)
-            addIndices(baseVertexIndex, k + 1, k);
-        else
-            addIndices(baseVertexIndex, baseVertexIndex + 1, k);
+        float scale = height / (base + top);
+        base *= scale;
+        top *= scale;
     }
 
-    // remember where the top index starts
-    topIndex = (unsigned int)indices.size();
-    unsigned int topVertexIndex = (unsigned int)vertices.size() / 3;
+    float t0 = base / height;               // params along the side
+    float t1 = 1.0f - top / height;
+    zBase += base;
+    zTop -= top;
+    rBase = baseRadius + t0 * (topRadius - baseRadius);
+    rTop = baseRadius + t1 * (topRadius - baseRadius);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// add center and ring vertices of a cap at z, facing -Z (base) or +Z (top)
+// return the index of the center vertex
+///////////////////////////////////////////////////////////////////////////////
+unsigned int Cylinder::addCapVertices(float z, float radius, bool top)
+{
+    unsigned int centerIndex = (unsigned int)vertices.size() / 3;
+    float nz = top ? 1.0f : -1.0f;
+    float x, y;
 
-    // put vertices of top of cylinder
-    z = height * 0.5f;
     addVertex(0, 0, z);
-    addNormal(0, 0, 1);
+    addNormal(0, 0, nz);
     addTexCoord(0.5f, 0.5f);
-    for(i = 0, j = 0; i < sectorCount; ++i, j += 3)
+    for(int i = 0, j = 0; i < sectorCount; ++i, j += 3)
     {
         x = unitCircleVertices[j];
         y = unitCircleVertices[j+1];
-        addVertex(x * topRadius, y * topRadius, z);
-        addNormal(0, 0, 1);
-        addTexCoord(x * 0.5f + 0.5f, -y * 0.5f + 0.5f);
+        addVertex(x * radius, y * radius, z);
+        addNormal(0, 0, nz);
+        if(top)
+            addTexCoord(x * 0.5f + 0.5f, -y * 0.5f + 0.5f);
+        else
+            addTexCoord(-x * 0.5f + 0.5f, -y * 0.5f + 0.5f);    // flip horizontal
     }
+    return centerIndex;
+}
+
 
-    for(i = 0, k = topVertexIndex + 1; i < sectorCount; ++i, ++k)
+
+///////////////////////////////////////////////////////////////////////////////
+// add a triangle fan of a cap, CCW from outside
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::addCapIndices(unsigned int centerIndex, bool top)
+{
+    unsigned int k = centerIndex + 1;
+    for(int i = 0; i < sectorCount; ++i, ++k)
     {
-        if(i < sectorCount - 1)
-            addIndices(topVertexIndex, k, k + 1);
+        unsigned int next = (i < sectorCount - 1) ? k + 1 : centerIndex + 1;
+        if(top)
+            addIndices(centerIndex, k, next);
         else
-            addIndices(topVertexIndex, k, topVertexIndex + 1);
+            addIndices(centerIndex, next, k);
     }
-
-    // generate interleaved vertex array as well
-    buildInterleavedVertices();
 }
 
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// generate interleaved vertices: V/N/T
-// stride must be 32 bytes
+// reserve exact capacity of the arrays for push_back, so a build allocates
+// each of them once
 ///////////////////////////////////////////////////////////////////////////////
-void Cylinder::buildInterleavedVertices()
+void Cylinder::reserveArrays(std::size_t vertexCount, std::size_t indexCount, std::size_t lineIndexCount)
 {
-    std::vector<float>().swap(interleavedVertices);
+    vertices.reserve(vertexCount * 3);
+    normals.reserve(vertexCount * 3);
+    texCoords.reserve(vertexCount * 2);
+    indices.reserve(indexCount);
+    lineIndices.reserve(lineIndexCount);
+}
 
-    std::size_t i, j;
-    std::size_t count = vertices.size();
-    for(i = 0, j = 0; i < count; i += 3, j += 2)
-    {
-        //interleavedVertices.push_back(vertices[i]);
-        //interleavedVertices.push_back(vertices[i+1]);
-        //interleavedVertices.push_back(vertices[i+2]);
-        interleavedVertices.insert(interleavedVertices.end(), &vertices[i], &vertices[i] + 3);
 
-        //interleavedVertices.push_back(normals[i]);
-        //interleavedVertices.push_back(normals[i+1]);
-        //interleavedVertices.push_back(normals[i+2]);
-        interleavedVertices.insert(interleavedVertices.end(), &normals[i], &normals[i] + 3);
 
-        //interleavedVertices.push_back(texCoords[j]);
-        //interleavedVertices.push_back(texCoords[j+1]);
-        interleavedVertices.insert(interleavedVertices.end(), &texCoords[j], &texCoords[j] + 2);
-    }
+///////////////////////////////////////////////////////////////////////////////
+// release separate vertex/normal/texcoord arrays for single storage mode
+// The interleaved (or compact) array is the only copy after this.
+///////////////////////////////////////////////////////////////////////////////
+void Cylinder::clearAttribArrays()
+{
+    std::vector<float>().swap(vertices);
+    std::vector<float>().swap(normals);
+    std::vector<float>().swap(texCoords);
 }
 
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// generate 3D vertices of a unit circle on XY plance
+// get 3D vertices of a unit circle on XY plance
+// The ring of each sector count is computed once and shared by all instances,
+// so rebuilding many cylinders with the same sector count skips sin/cos.
 ///////////////////////////////////////////////////////////////////////////////
 void Cylinder::buildUnitCircleVertices()
 {
-    const float PI = acos(-1);
-    float sectorStep = 2 * PI / sectorCount;
-    float sectorAngle;  // radian
+    std::lock_guard<std::mutex> lock(getUnitCircleMutex());
 
-    std::vector<float>().swap(unitCircleVertices);
-    for(int i = 0; i <= sectorCount; ++i)
+    std::vector<float>& ring = getUnitCircleRings()[sectorCount];
+    if(ring.empty())
     {
-        sectorAngle = i * sectorStep;
-        unitCircleVertices.push_back(cos(sectorAngle)); // x
-        unitCircleVertices.push_back(sin(sectorAngle)); // y
-        unitCircleVertices.push_back(0);                // z
+        const float PI = acos(-1);
+        float sectorStep = 2 * PI / sectorCount;
+        float sectorAngle;  // radian
+
+        ring.reserve((sectorCount + 1) * 3);
+        for(int i = 0; i <= sectorCount; ++i)
+        {
+            sectorAngle = i * sectorStep;
+            ring.push_back(cos(sectorAngle));   // x
+            ring.push_back(sin(sectorAngle));   // y
+            ring.push_back(0);                  // z
+        }
     }
+    unitCircleVertices = ring.data();
 }
 
 
@@ -655,78 +1306,37 @@ void Cylinder::addIndices(unsigned int i1, unsigned int i2, unsigned int i3)
 
 ///////////////////////////////////////////////////////////////////////////////
 // generate shared normal vectors of the side of cylinder
+// The normal at 0 degree is (cos(zAngle), 0, sin(zAngle)), and rotating it by
+// the sector angle only scales the unit circle, so no sin/cos per sector.
 ///////////////////////////////////////////////////////////////////////////////
-std::vector<float> Cylinder::getSideNormals()
+const std::vector<float>& Cylinder::getSideNormals()
 {
-    const float PI = acos(-1);
-    float sectorStep = 2 * PI / sectorCount;
-    float sectorAngle;  // radian
-
-    // compute the normal vector at 0 degree first
     // tanA = (baseRadius-topRadius) / height
     float zAngle = atan2(baseRadius - topRadius, height);
-    float x0 = cos(zAngle);     // nx
-    float y0 = 0;               // ny
-    float z0 = sin(zAngle);     // nz
+    float xy = cos(zAngle);     // nx, ny scale
+    float z = sin(zAngle);      // nz
 
-    // rotate (x0,y0,z0) per sector angle
-    std::vector<float> normals;
-    for(int i = 0; i <= sectorCount; ++i)
+    sideNormals.resize((sectorCount + 1) * 3);
+    for(int i = 0, k = 0; i <= sectorCount; ++i, k += 3)
     {
-        sectorAngle = i * sectorStep;
-        normals.push_back(cos(sectorAngle)*x0 - sin(sectorAngle)*y0);   // nx
-        normals.push_back(sin(sectorAngle)*x0 + cos(sectorAngle)*y0);   // ny
-        normals.push_back(z0);  // nz
-        /*
-        //debug
-        float nx = cos(sectorAngle)*x0 - sin(sectorAngle)*y0;
-        float ny = sin(sectorAngle)*x0 + cos(sectorAngle)*y0;
-        std::cout << "normal=(" << nx << ", " << ny << ", " << z0
-                  << "), length=" << sqrtf(nx*nx + ny*ny + z0*z0) << std::endl;
-        */
+        sideNormals[k]   = unitCircleVertices[k] * xy;
+        sideNormals[k+1] = unitCircleVertices[k+1] * xy;
+        sideNormals[k+2] = z;
     }
-
-    return normals;
+    return sideNormals;
 }
 
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// return face normal of a triangle v1-v2-v3
+// compute face normal of a triangle v1-v2-v3
 // if a triangle has no surface (normal length = 0), then return a zero vector
 ///////////////////////////////////////////////////////////////////////////////
-std::vector<float> Cylinder::computeFaceNormal(float x1, float y1, float z1,  // v1
-                                               float x2, float y2, float z2,  // v2
-                                               float x3, float y3, float z3)  // v3
+vec3 Cylinder::computeFaceNormal(const vec3& v1, const vec3& v2, const vec3& v3)
 {
     const float EPSILON = 0.000001f;
 
-    std::vector<float> normal(3, 0.0f);     // default return value (0,0,0)
-    float nx, ny, nz;
-
-    // find 2 edge vectors: v1-v2, v1-v3
-    float ex1 = x2 - x1;
-    float ey1 = y2 - y1;
-    float ez1 = z2 - z1;
-    float ex2 = x3 - x1;
-    float ey2 = y3 - y1;
-    float ez2 = z3 - z1;
-
-    // cross product: e1 x e2
-    nx = ey1 * ez2 - ez1 * ey2;
-    ny = ez1 * ex2 - ex1 * ez2;
-    nz = ex1 * ey2 - ey1 * ex2;
-
-    // normalize only if the length is > 0
-    float length = sqrtf(nx * nx + ny * ny + nz * nz);
-    if(length > EPSILON)
-    {
-        // normalize
-        float lengthInv = 1.0f / length;
-        normal[0] = nx * lengthInv;
-        normal[1] = ny * lengthInv;
-        normal[2] = nz * lengthInv;
-    }
-
-    return normal;
+    // cross product of 2 edge vectors: v1-v2, v1-v3
+    // then normalize only if the length is > 0, otherwise (0,0,0)
+    return normalize(cross(v2 - v1, v3 - v1), EPSILON);
 }
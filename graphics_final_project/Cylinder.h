@@ -4,13 +4,27 @@
 #define GEOMETRY_CYLINDER_H
 
 #include <vector>
+#include <cstddef>
+#include "CompactVertices.h"
+#include "MeshOptimizer.h"
+#include "Math3d.h"
+#include "MeshBuffers.h"
 
 class Cylinder
 {
 public:
+    // range of bytes in interleaved array
+    struct ByteRange
+    {
+        std::size_t offset;
+        std::size_t size;
+    };
+
     // ctor/dtor
+    // build=false defers the build to commit() or the first access, so that
+    // setters called right after construction do not build it twice
     Cylinder(float baseRadius=1.0f, float topRadius=1.0f, float height=1.0f,
-             int sectorCount=36, int stackCount=1, bool smooth=true);
+             int sectorCount=36, int stackCount=1, bool smooth=true, bool build=true);
     ~Cylinder() {}
 
     // getters/setters
@@ -19,6 +33,7 @@ public:
     float getHeight() const                 { return height; }
     int getSectorCount() const              { return sectorCount; }
     int getStackCount() const               { return stackCount; }
+    bool getSmooth() const                  { return smooth; }
     void set(float baseRadius, float topRadius, float height,
              int sectorCount, int stackCount, bool smooth=true);
     void setBaseRadius(float radius);
@@ -28,38 +43,105 @@ public:
     void setStackCount(int stackCount);
     void setSmooth(bool smooth);
 
+    // setters only record parameters, the geometry is rebuilt once on the
+    // first access or draw; commit() pays the cost now
+    void commit();
+    unsigned int getRebuildCount() const    { return rebuildCount; }    // full rebuilds only
+    unsigned int getUpdateCount() const     { return updateCount; }     // in-place position updates
+
+    // byte ranges of interleaved array changed since the last clear, so an
+    // uploader can patch only those; a rebuild changes the whole array, but
+    // radius/height changes on the same topology move the vertices in place
+    const std::vector<ByteRange>& getChangedRanges() const { update(); return changedRanges; }
+    void clearChangedRanges()               { changedRanges.clear(); }
+
     // for vertex data
-    unsigned int getVertexCount() const     { return (unsigned int)vertices.size() / 3; }
-    unsigned int getNormalCount() const     { return (unsigned int)normals.size() / 3; }
-    unsigned int getTexCoordCount() const   { return (unsigned int)texCoords.size() / 2; }
-    unsigned int getIndexCount() const      { return (unsigned int)indices.size(); }
-    unsigned int getLineIndexCount() const  { return (unsigned int)lineIndices.size(); }
+    // vertex/normal/texcoord arrays are empty in single storage mode
+    unsigned int getVertexCount() const;
+    unsigned int getNormalCount() const     { update(); return (unsigned int)normals.size() / 3; }
+    unsigned int getTexCoordCount() const   { update(); return (unsigned int)texCoords.size() / 2; }
+    unsigned int getIndexCount() const      { update(); return (unsigned int)(shortIndex ? shortIndices.size() : indices.size()); }
+    unsigned int getLineIndexCount() const  { update(); return (unsigned int)(shortIndex ? shortLineIndices.size() : lineIndices.size()); }
     unsigned int getTriangleCount() const   { return getIndexCount() / 3; }
-    unsigned int getVertexSize() const      { return (unsigned int)vertices.size() * sizeof(float); }
-    unsigned int getNormalSize() const      { return (unsigned int)normals.size() * sizeof(float); }
-    unsigned int getTexCoordSize() const    { return (unsigned int)texCoords.size() * sizeof(float); }
-    unsigned int getIndexSize() const       { return (unsigned int)indices.size() * sizeof(unsigned int); }
-    unsigned int getLineIndexSize() const   { return (unsigned int)lineIndices.size() * sizeof(unsigned int); }
-    const float* getVertices() const        { return vertices.data(); }
-    const float* getNormals() const         { return normals.data(); }
-    const float* getTexCoords() const       { return texCoords.data(); }
-    const unsigned int* getIndices() const  { return indices.data(); }
-    const unsigned int* getLineIndices() const  { return lineIndices.data(); }
+    unsigned int getVertexSize() const      { update(); return (unsigned int)vertices.size() * sizeof(float); }
+    unsigned int getNormalSize() const      { update(); return (unsigned int)normals.size() * sizeof(float); }
+    unsigned int getTexCoordSize() const    { update(); return (unsigned int)texCoords.size() * sizeof(float); }
+    unsigned int getIndexSize() const       { return getIndexCount() * getIndexElementSize(); }
+    unsigned int getLineIndexSize() const   { return getLineIndexCount() * getIndexElementSize(); }
+    const float* getVertices() const        { update(); return vertices.data(); }
+    const float* getNormals() const         { update(); return normals.data(); }
+    const float* getTexCoords() const       { update(); return texCoords.data(); }
+    // typed index arrays return NULL if the indices are packed the other way,
+    // use getIndexData()/getLineIndexData() with getIndexType() instead
+    const unsigned int* getIndices() const  { update(); return shortIndex ? 0 : indices.data(); }          // 32-bit indices only
+    const unsigned int* getLineIndices() const  { update(); return shortIndex ? 0 : lineIndices.data(); }
+    const unsigned short* getShortIndices() const { update(); return shortIndex ? shortIndices.data() : 0; }   // 16-bit indices only
+    const unsigned short* getShortLineIndices() const { update(); return shortIndex ? shortLineIndices.data() : 0; }
+
+    // indices are 16-bit if # of vertices <= 65536, otherwise 32-bit
+    unsigned int getIndexType() const;      // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    unsigned int getIndexElementSize() const    { update(); return shortIndex ? sizeof(unsigned short) : sizeof(unsigned int); }
+    const void* getIndexData() const        { update(); return shortIndex ? (const void*)shortIndices.data() : (const void*)indices.data(); }
+    const void* getLineIndexData() const    { update(); return shortIndex ? (const void*)shortLineIndices.data() : (const void*)lineIndices.data(); }
 
     // for interleaved vertices: V/N/T
     unsigned int getInterleavedVertexCount() const  { return getVertexCount(); }    // # of vertices
-    unsigned int getInterleavedVertexSize() const   { return (unsigned int)interleavedVertices.size() * sizeof(unsigned int); }    // # of bytes
-    int getInterleavedStride() const                { return interleavedStride; }   // should be 32 bytes
-    const float* getInterleavedVertices() const     { return &interleavedVertices[0]; }
+    unsigned int getInterleavedVertexSize() const;  // # of bytes
+    int getInterleavedStride() const                { update(); return interleavedStride; }   // 32 or 16 bytes
+    const float* getInterleavedVertices() const     { update(); return interleavedVertices.data(); }  // VERTEX_FLOAT only
+    VertexFormat getVertexFormat() const            { return vertexFormat; }
+    void setVertexFormat(VertexFormat format);
+    const CompactVertices& getCompactVertices() const { update(); return compactVertices; } // VERTEX_COMPACT only
+
+    // vertex cache and fetch optimization after build (off by default)
+    bool getOptimized() const               { return optimized; }
+    void setOptimized(bool optimized);
+    const VertexCacheStats& getCacheStatsBefore() const { update(); return cacheStatsBefore; }  // valid if optimized
+    const VertexCacheStats& getCacheStatsAfter() const  { update(); return cacheStatsAfter; }
+
+    // flat shading with shared vertices and the face normal on the provoking
+    // vertex, drawn with GL_FLAT (off by default)
+    bool getWelded() const                  { return welded; }
+    void setWelded(bool welded);
+    unsigned int getMemorySize() const;     // # of bytes of all vertex and index arrays
+
+    // keep the interleaved (or compact) array only and release the separate
+    // vertex/normal/texcoord arrays after build (off by default)
+    bool getSingleStorage() const           { return singleStorage; }
+    void setSingleStorage(bool single);
+
+    // strut mode: stacks are clamped to 1, caps flagged hidden (both by
+    // default) are not built and each end can be trimmed (off by default)
+    bool getStrut() const                   { return strut; }
+    void setStrut(bool strut);
+    bool getBaseHidden() const              { return baseHidden; }
+    bool getTopHidden() const               { return topHidden; }
+    void setHiddenCaps(bool base, bool top);
+    float getBaseTrim() const               { return baseTrim; }
+    float getTopTrim() const                { return topTrim; }
+    void setTrim(float base, float top);    // length cut from each end
+    static float computeNodeTrim(float nodeRadius, float radius);
 
     // for indices of base/top/side parts
-    unsigned int getBaseIndexCount() const  { return ((unsigned int)indices.size() - baseIndex) / 2; }
-    unsigned int getTopIndexCount() const   { return ((unsigned int)indices.size() - baseIndex) / 2; }
-    unsigned int getSideIndexCount() const  { return baseIndex; }
-    unsigned int getBaseStartIndex() const  { return baseIndex; }
-    unsigned int getTopStartIndex() const   { return topIndex; }
+    unsigned int getBaseIndexCount() const  { update(); return topIndex - baseIndex; }
+    unsigned int getTopIndexCount() const   { update(); return getIndexCount() - topIndex; }
+    unsigned int getSideIndexCount() const  { update(); return baseIndex; }
+    unsigned int getBaseStartIndex() const  { update(); return baseIndex; }
+    unsigned int getTopStartIndex() const   { update(); return topIndex; }
     unsigned int getSideStartIndex() const  { return 0; }   // side starts from the begining
 
+    // draw from buffer objects uploaded once per build (see MeshBuffers),
+    // or from client arrays if they are not available
+    unsigned int getBufferUploadCount() const   { return buffers.getUploadCount(); }
+    void releaseBuffers()                   { buffers.release(); }    // GL context must be current
+
+    // set up the triangle arrays once to draw many copies (see InstanceBatch)
+    // return true if they are buffer objects, then indices are offsets
+    bool beginDraw() const;
+    void endDraw(bool buffered) const;
+    bool beginDrawLines() const;            // same for GL_LINES with getLineIndexData()
+    void endDrawLines(bool buffered) const;
+
     // draw in VertexArray mode
     void draw() const;          // draw all
     void drawBase() const;      // draw base cap only
@@ -76,38 +158,93 @@ protected:
 private:
     // member functions
     void clearArrays();
+    void reserveArrays(std::size_t vertexCount, std::size_t indexCount, std::size_t lineIndexCount);
+    void getSideExtent(float& zBase, float& zTop, float& rBase, float& rTop) const;
+    bool hasBase() const                    { return !(strut && baseHidden); }
+    bool hasTop() const                     { return !(strut && topHidden); }
+    unsigned int addCapVertices(float z, float radius, bool top);
+    void addCapIndices(unsigned int centerIndex, bool top);
+    void buildVertices();
     void buildVerticesSmooth();
     void buildVerticesFlat();
     void buildInterleavedVertices();
+    void buildCompactVertices();
+    void clearAttribArrays();
+    void update() const                     { if(dirty || moved) const_cast<Cylinder*>(this)->commit(); }
+    bool canUpdatePositions() const;
+    void updatePositions();
+    bool setVertex(std::size_t index, const float v[3], const float n[3]);
+    void addChangedRange(std::size_t offset, std::size_t size);
+    void weldVertices();
+    void optimizeVertices();
+    bool isWelded() const                   { return welded && !smooth; }
+    void packIndices();
+    bool bindBuffers(bool lines) const;
+    void enableVertexArrays(bool buffered) const;
+    void disableVertexArrays(bool buffered) const;
     void buildUnitCircleVertices();
     void addVertex(float x, float y, float z);
     void addNormal(float x, float y, float z);
     void addTexCoord(float s, float t);
     void addIndices(unsigned int i1, unsigned int i2, unsigned int i3);
-    std::vector<float> getSideNormals();
-    std::vector<float> computeFaceNormal(float x1, float y1, float z1,
-                                         float x2, float y2, float z2,
-                                         float x3, float y3, float z3);
+    const std::vector<float>& getSideNormals();
+    static vec3 computeFaceNormal(const vec3& v1, const vec3& v2, const vec3& v3);
 
     // memeber vars
     float baseRadius;
     float topRadius;
     float height;
     int sectorCount;                        // # of slices
-    int stackCount;                         // # of stacks
+    int stackCount;                         // # of stacks built, 1 in strut mode
+    int requestedStackCount;                // # of stacks set, used again without strut mode
     unsigned int baseIndex;                 // starting index of base
     unsigned int topIndex;                  // starting index of top
     bool smooth;
-    std::vector<float> unitCircleVertices;
+    const float* unitCircleVertices;        // shared ring of (sectorCount+1) x,y,z
+    std::vector<float> sideNormals;         // reused buffer of getSideNormals()
     std::vector<float> vertices;
     std::vector<float> normals;
     std::vector<float> texCoords;
     std::vector<unsigned int> indices;
     std::vector<unsigned int> lineIndices;
+    std::vector<unsigned short> shortIndices;        // packed indices if they fit in 16 bits
+    std::vector<unsigned short> shortLineIndices;
+    bool shortIndex;                        // true if indices are packed in 16 bits
 
     // interleaved
     std::vector<float> interleavedVertices;
-    int interleavedStride;                  // # of bytes to hop to the next vertex (should be 32 bytes)
+    int interleavedStride;                  // # of bytes to hop to the next vertex (32 or 16 bytes)
+    VertexFormat vertexFormat;
+    CompactVertices compactVertices;        // quantized copy replacing interleavedVertices
+
+    // vertex cache optimization
+    bool optimized;
+    VertexCacheStats cacheStatsBefore;      // ACMR/ATVR of generated order
+    VertexCacheStats cacheStatsAfter;       // ACMR/ATVR after optimization
+
+    // welded flat shading
+    bool welded;
+    unsigned int flatVertexCount;           // # of vertices before welding
+
+    // vertex/normal/texcoord arrays are build scratch only
+    bool singleStorage;
+
+    // GPU copies of interleaved vertices and indices, uploaded on draw
+    MeshBuffers buffers;
+
+    // strut mode
+    bool strut;
+    bool baseHidden;                        // caps not built in strut mode
+    bool topHidden;
+    float baseTrim;                         // length cut from each end in strut mode
+    float topTrim;
+
+    // deferred rebuild
+    bool dirty;                             // parameters changed since last build
+    bool moved;                             // radius/height changed only, same topology
+    unsigned int rebuildCount;              // # of rebuilds performed
+    unsigned int updateCount;               // # of in-place updates performed
+    std::vector<ByteRange> changedRanges;   // sorted, not overlapping
 
 };
 
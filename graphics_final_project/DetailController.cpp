@@ -0,0 +1,199 @@
+///////////////////////////////////////////////////////////////////////////////
+// DetailController.cpp
+// ====================
+// frame-time budget for tessellation
+///////////////////////////////////////////////////////////////////////////////
+
+#define GL_SILENCE_DEPRECATION // silence deprecation warnings
+
+#ifdef _WIN32
+#include <windows.h>    // include windows.h to avoid thousands of compile errors even though this class is not depending on Windows
+#endif
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <OpenGL/glext.h>
+#else
+#define GL_GLEXT_PROTOTYPES     // query functions are GL 1.5, not in gl.h
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include "DetailController.h"
+
+// no function loader for GL 1.5+ on Windows, so the frame time is CPU time
+// only there
+#ifndef _WIN32
+#define TIMER_QUERY_SUPPORTED
+#endif
+
+// the legacy context of macOS has the EXT entry point only
+#ifdef __APPLE__
+#define GET_QUERY_RESULT_64 glGetQueryObjectui64vEXT
+#else
+#define GET_QUERY_RESULT_64 glGetQueryObjectui64v
+#endif
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF              // same as GL_TIME_ELAPSED_EXT
+#endif
+
+// constants //////////////////////////////////////////////////////////////////
+const float AVERAGE_WEIGHT = 0.1f;          // weight of new frame, ~10 frames
+const float FINER_RATIO    = 0.6f;          // go finer under target * ratio
+const int   HOLD_FRAMES    = 30;            // # of frames to keep a new bias
+const int   SKIP_FRAMES    = 2;             // # of frames not measured after a step
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor
+///////////////////////////////////////////////////////////////////////////////
+DetailController::DetailController(float targetMs, int maxBias) : target(targetMs), maxBias(0), bias(0),
+                                                                  frameTime(0), average(0), holdFrames(0),
+                                                                  skipFrames(0), gpuTime(0), queryState(-1),
+                                                                  queryIndex(0), queryPending(false)
+{
+    queries[0] = queries[1] = 0;
+    setMaxBias(maxBias);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// setters
+///////////////////////////////////////////////////////////////////////////////
+void DetailController::setTarget(float ms)
+{
+    if(ms > 0)
+        target = ms;
+}
+
+void DetailController::setMaxBias(int bias)
+{
+    maxBias = bias > 0 ? bias : 0;
+    if(this->bias > maxBias)
+        this->bias = maxBias;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// measure a frame
+// The CPU time is from beginFrame() to endFrame(). The GPU time comes from a
+// GL_TIME_ELAPSED query around the same commands, read back one frame later
+// and only if it is ready, so measuring never waits for the GPU. The frame
+// time is the slower of the two.
+// Finer tessellation costs up to several times more triangles, so the bias
+// goes finer only well under the target, otherwise it would step back and
+// forth between two levels around the target.
+///////////////////////////////////////////////////////////////////////////////
+void DetailController::beginFrame()
+{
+    frameStart = Clock::now();
+
+#ifdef TIMER_QUERY_SUPPORTED
+    if(isTimerQueryAvailable())
+        glBeginQuery(GL_TIME_ELAPSED, queries[queryIndex]);
+#endif
+}
+
+void DetailController::endFrame()
+{
+    frameTime = std::chrono::duration<float, std::milli>(Clock::now() - frameStart).count();
+
+#ifdef TIMER_QUERY_SUPPORTED
+    if(isTimerQueryAvailable())
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+
+        // the query of the previous frame
+        GLuint query = queries[1 - queryIndex];
+        GLint ready = 0;
+        if(queryPending)
+            glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &ready);
+        if(ready)
+        {
+            GLuint64 ns = 0;
+            GET_QUERY_RESULT_64(query, GL_QUERY_RESULT, &ns);
+            gpuTime = ns / 1000000.0f;
+        }
+        queryPending = true;
+        queryIndex = 1 - queryIndex;
+
+        if(gpuTime > frameTime)
+            frameTime = gpuTime;
+    }
+#endif
+
+    // frames right after a step pay once for the new levels (mesh builds,
+    // buffer uploads), and the GPU time lags one frame, so skip them
+    if(skipFrames > 0)
+    {
+        --skipFrames;
+        return;
+    }
+
+    // the first frame starts the average as is
+    if(average == 0)
+        average = frameTime;
+    else
+        average += (frameTime - average) * AVERAGE_WEIGHT;
+
+    if(holdFrames > 0)
+    {
+        --holdFrames;
+        return;
+    }
+
+    if(average > target && bias < maxBias)
+    {
+        ++bias;
+        step();
+    }
+    else if(average < target * FINER_RATIO && bias > 0)
+    {
+        --bias;
+        step();
+    }
+}
+
+// restart the average on the new tessellation
+void DetailController::step()
+{
+    holdFrames = HOLD_FRAMES;
+    skipFrames = SKIP_FRAMES;
+    average = 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// timer queries are core in GL 3.3, or ARB/EXT_timer_query
+// The query objects are created on the first call with a current context.
+///////////////////////////////////////////////////////////////////////////////
+bool DetailController::isTimerQueryAvailable()
+{
+#ifdef TIMER_QUERY_SUPPORTED
+    if(queryState < 0)
+    {
+        const char* version = (const char*)glGetString(GL_VERSION);
+        const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+        if(!version)
+            return false;                   // no context yet, try again later
+
+        int major = 0, minor = 0;
+        sscanf(version, "%d.%d", &major, &minor);
+        bool supported = major > 3 || (major == 3 && minor >= 3) ||
+                         (extensions && (strstr(extensions, "GL_ARB_timer_query") ||
+                                         strstr(extensions, "GL_EXT_timer_query")));
+        queryState = supported ? 1 : 0;
+        if(supported)
+            glGenQueries(2, queries);
+    }
+    return queryState == 1;
+#else
+    return false;
+#endif
+}
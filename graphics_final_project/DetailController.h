@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////////////////////////////////
+// DetailController.h
+// ==================
+// frame-time budget for tessellation
+// It measures each frame between beginFrame() and endFrame(), on the CPU and
+// with a GPU timer query read back a frame late, smooths the time, and moves
+// a global detail bias one step at a time: coarser while the average is over
+// the target, finer again once it is well under. The bias is the # of levels
+// to add to the level picked on screen (see LodChain).
+// After each step the average restarts on the new tessellation and the bias
+// is held for a while, so it does not oscillate.
+// beginFrame()/endFrame() need the GL context current, and the GPU time
+// cannot include the buffer swap, so call endFrame() before swapping.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef GEOMETRY_DETAIL_CONTROLLER_H
+#define GEOMETRY_DETAIL_CONTROLLER_H
+
+#include <chrono>
+
+class DetailController
+{
+public:
+    DetailController(float targetMs=16.0f, int maxBias=0);
+
+    float getTarget() const                 { return target; }      // ms per frame
+    void setTarget(float ms);
+    int getMaxBias() const                  { return maxBias; }
+    void setMaxBias(int bias);              // coarsest bias, 0 = fixed
+
+    // measure a frame, endFrame() updates the bias
+    void beginFrame();
+    void endFrame();
+    int getBias() const                     { return bias; }
+    float getFrameTime() const              { return frameTime; }   // ms of last frame
+    float getGpuTime() const                { return gpuTime; }     // ms, 1 frame behind
+    float getAverage() const                { return average; }     // smoothed ms
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    void step();
+    bool isTimerQueryAvailable();
+
+    float target;
+    int maxBias;
+    int bias;
+    Clock::time_point frameStart;
+    float frameTime;
+    float average;
+    int holdFrames;                         // # of frames left before next step
+    int skipFrames;                         // # of frames left to not measure
+    float gpuTime;
+    int queryState;                         // -1: unknown, 0: no timer query, 1: ok
+    unsigned int queries[2];                // GL_TIME_ELAPSED, this and last frame
+    int queryIndex;                         // query of this frame
+    bool queryPending;                      // last frame has a result to read
+};
+
+#endif
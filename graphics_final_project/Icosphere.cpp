@@ -13,11 +13,18 @@
 #include <iostream>
 #include <iomanip>
 #include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include "Icosphere.h"
 
 
 
 // constants //////////////////////////////////////////////////////////////////
+const unsigned long long EMPTY_EDGE = ~0ull;   // unused slot of edge cache
+const unsigned char SEAM_12 = 1;                // seam flags of triangle edges:
+const unsigned char SEAM_23 = 2;                // v1-v2, v2-v3 and v3-v1
+const unsigned char SEAM_31 = 4;
 
 
 
@@ -25,12 +32,18 @@
 ///////////////////////////////////////////////////////////////////////////////
 // ctor
 ///////////////////////////////////////////////////////////////////////////////
-Icosphere::Icosphere(float radius, int sub, bool smooth) : radius(radius), subdivision(sub), smooth(smooth), interleavedStride(32)
+Icosphere::Icosphere(float radius, int sub, bool smooth, bool build) : radius(radius), subdivision(sub), smooth(smooth),
+                                                                       buildMode(SUBDIVIDE), frequency(1 << sub), threadCount(1),
+                                                                       shortIndex(false), interleavedStride(32),
+                                                                       vertexFormat(VERTEX_FLOAT), optimized(false),
+                                                                       welded(false), flatVertexCount(0), singleStorage(false),
+                                                                       dirty(true), rebuildCount(0),
+                                                                       levelCacheSize(0), levelCacheUsage(0)
 {
-    if(smooth)
-        buildVerticesSmooth();
-    else
-        buildVerticesFlat();
+    cacheStatsBefore.acmr = cacheStatsBefore.atvr = 0;
+    cacheStatsAfter = cacheStatsBefore;
+    if(build)
+        commit();   // build now, a const object cannot be built later
 }
 
 
@@ -41,17 +54,18 @@ Icosphere::Icosphere(float radius, int sub, bool smooth) : radius(radius), subdi
 void Icosphere::setRadius(float radius)
 {
     this->radius = radius;
-    updateRadius(); // update vertex positions only
+    if(!dirty)
+        updateRadius(); // update vertex positions only
 }
 
 void Icosphere::setSubdivision(int iteration)
 {
+    if(this->subdivision == iteration && this->frequency == (1 << iteration))
+        return;
+
     this->subdivision = iteration;
-    // rebuild vertices
-    if(smooth)
-        buildVerticesSmooth();
-    else
-        buildVerticesFlat();
+    this->frequency = 1 << iteration;
+    dirty = true;       // rebuild on next access
 }
 
 void Icosphere::setSmooth(bool smooth)
@@ -60,10 +74,153 @@ void Icosphere::setSmooth(bool smooth)
         return;
 
     this->smooth = smooth;
-    if(smooth)
-        buildVerticesSmooth();
+    dirty = true;       // rebuild on next access
+}
+
+void Icosphere::setBuildMode(BuildMode mode)
+{
+    if(this->buildMode == mode)
+        return;
+
+    this->buildMode = mode;
+    if(mode == SUBDIVIDE)
+        this->frequency = 1 << subdivision; // subdivision supports 2^n only
+    dirty = true;       // rebuild on next access
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// select layout of interleaved vertices
+// VERTEX_COMPACT quantizes V/N/T to 16 bytes and frees the float array
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::setVertexFormat(VertexFormat format)
+{
+    if(this->vertexFormat == format)
+        return;
+
+    // convert now if built, otherwise the next rebuild does it
+    this->vertexFormat = format;
+    if(format == VERTEX_COMPACT)
+    {
+        if(!dirty)
+            buildCompactVertices();
+    }
+    else
+    {
+        compactVertices.clear();
+        interleavedStride = 32;
+        if(singleStorage)
+            dirty = true;   // nothing left to expand, rebuild on next access
+        else if(!dirty)
+            buildInterleavedVertices();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// enable/disable vertex cache optimization, rebuilt on next access
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::setOptimized(bool optimized)
+{
+    if(this->optimized == optimized)
+        return;
+
+    this->optimized = optimized;
+    dirty = true;       // rebuild on next access
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// use welded vertices for flat shading, rebuilt on next access
+// It has no effect on smooth shading.
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::setWelded(bool welded)
+{
+    if(this->welded == welded)
+        return;
+
+    this->welded = welded;
+    if(!smooth)
+        dirty = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// keep only the interleaved or compact array after build
+// Turning it off needs the separate arrays again, so rebuild on next access.
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::setSingleStorage(bool single)
+{
+    if(this->singleStorage == single)
+        return;
+
+    this->singleStorage = single;
+    if(single && !dirty)
+        clearAttribArrays();
     else
-        buildVerticesFlat();
+        dirty = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// rebuild vertices if any parameter has changed since the last build
+// Setters only mark the geometry dirty, so consecutive changes cost a single
+// rebuild. Accessors and draw functions call it if the caller did not.
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::commit()
+{
+    if(!dirty)
+        return;
+
+    dirty = false;
+    ++rebuildCount;
+    buildVertices();
+    buffers.invalidate();
+}
+
+unsigned int Icosphere::getVertexCount() const
+{
+    update();
+    if(vertexFormat == VERTEX_COMPACT)
+        return (unsigned int)compactVertices.getCount();
+    return (unsigned int)interleavedVertices.size() / 8;
+}
+
+unsigned int Icosphere::getInterleavedVertexSize() const
+{
+    update();
+    if(vertexFormat == VERTEX_COMPACT)
+        return (unsigned int)compactVertices.getSize();
+    return (unsigned int)interleavedVertices.size() * sizeof(float);
+}
+
+unsigned int Icosphere::getMemorySize() const
+{
+    update();
+    return getVertexSize() + getNormalSize() + getTexCoordSize() + getInterleavedVertexSize() +
+           getIndexSize() + getLineIndexSize();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// set # of threads for DIRECT build, 0 for all hardware threads
+// The output is identical to the serial build regardless of the thread count.
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::setThreadCount(int count)
+{
+    threadCount = (count < 0) ? 1 : count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// set # of segments per edge of icosahedron
+// Any frequency is allowed with direct build, so it switches to DIRECT mode
+// and subdivision becomes the largest level that is not finer than it.
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::setFrequency(int frequency)
+{
+    if(frequency < 1)
+        frequency = 1;
+
+    this->frequency = frequency;
+    this->subdivision = 0;
+    while((2 << subdivision) <= frequency)
+        ++subdivision;
+    this->buildMode = DIRECT;
+    dirty = true;       // rebuild on next access
 }
 
 
@@ -73,16 +230,31 @@ void Icosphere::setSmooth(bool smooth)
 ///////////////////////////////////////////////////////////////////////////////
 void Icosphere::printSelf() const
 {
+    update();
 
     std::cout << "===== Icosphere =====\n"
               << "        Radius: " << radius << "\n"
               << "   Subdivision: " << subdivision << "\n"
+              << "     Frequency: " << frequency << "\n"
+              << "    Build Mode: " << (buildMode == DIRECT ? "direct" : "subdivide") << "\n"
               << "    Smoothness: " << (smooth ? "true" : "false") << "\n"
               << "Triangle Count: " << getTriangleCount() << "\n"
               << "   Index Count: " << getIndexCount() << "\n"
               << "  Vertex Count: " << getVertexCount() << "\n"
               << "  Normal Count: " << getNormalCount() << "\n"
-              << "TexCoord Count: " << getTexCoordCount() << std::endl;
+              << "TexCoord Count: " << getTexCoordCount() << "\n"
+              << "   Memory Size: " << getMemorySize() << " bytes\n"
+              << " Vertex Format: " << (vertexFormat == VERTEX_COMPACT ? "compact" : "float")
+              << " (" << interleavedStride << " bytes)" << std::endl;
+    if(isWelded())
+    {
+        std::cout << "  Welded Count: " << getVertexCount() << " (unwelded: " << flatVertexCount << ")" << std::endl;
+    }
+    if(optimized)
+    {
+        std::cout << "   Cache ACMR: " << cacheStatsBefore.acmr << " -> " << cacheStatsAfter.acmr << "\n"
+                  << "   Cache ATVR: " << cacheStatsBefore.atvr << " -> " << cacheStatsAfter.atvr << std::endl;
+    }
 }
 
 
@@ -93,19 +265,95 @@ void Icosphere::printSelf() const
 ///////////////////////////////////////////////////////////////////////////////
 void Icosphere::draw() const
 {
-    // interleaved array
+    bool buffered = beginDraw();
+    glDrawElements(GL_TRIANGLES, getIndexCount(), getIndexType(), buffered ? 0 : getIndexData());
+    endDraw(buffered);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// bind and enable the interleaved array, from buffer objects if available
+// The caller draws triangles in between, once or per copy.
+///////////////////////////////////////////////////////////////////////////////
+bool Icosphere::beginDraw() const
+{
+    update();
+    bool buffered = bindBuffers(false);
+    enableVertexArrays(buffered);
+    return buffered;
+}
+
+void Icosphere::endDraw(bool buffered) const
+{
+    disableVertexArrays(buffered);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// bind buffer objects of vertices and triangle (or line) indices, uploading
+// them first if they changed since the last draw
+// Return false if not available, then the pointers are client memory.
+///////////////////////////////////////////////////////////////////////////////
+bool Icosphere::bindBuffers(bool lines) const
+{
+    bool compact = (vertexFormat == VERTEX_COMPACT);
+    if(!buffers.bindVertices(compact ? (const void*)compactVertices.getData() : (const void*)interleavedVertices.data(),
+                             getInterleavedVertexSize()))
+        return false;
+
+    if(lines)
+        return buffers.bindLineIndices(getLineIndexData(), getLineIndexSize());
+    return buffers.bindIndices(getIndexData(), getIndexSize());
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// enable and set V/N/T arrays of the current vertex format
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::enableVertexArrays(bool buffered) const
+{
+    // welded flat mesh has the face normal on the last vertex of triangle only
+    if(isWelded())
+    {
+        glPushAttrib(GL_LIGHTING_BIT);
+        glShadeModel(GL_FLAT);
+    }
+
+    if(vertexFormat == VERTEX_COMPACT)
+    {
+        compactVertices.beginDraw(buffered);
+        return;
+    }
+
+    const float* base = buffered ? 0 : &interleavedVertices[0];   // offsets if buffered
     glEnableClientState(GL_VERTEX_ARRAY);
     glEnableClientState(GL_NORMAL_ARRAY);
     glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glVertexPointer(3, GL_FLOAT, interleavedStride, &interleavedVertices[0]);
-    glNormalPointer(GL_FLOAT, interleavedStride, &interleavedVertices[3]);
-    glTexCoordPointer(2, GL_FLOAT, interleavedStride, &interleavedVertices[6]);
+    glVertexPointer(3, GL_FLOAT, interleavedStride, base);
+    glNormalPointer(GL_FLOAT, interleavedStride, base + 3);
+    glTexCoordPointer(2, GL_FLOAT, interleavedStride, base + 6);
+}
 
-    glDrawElements(GL_TRIANGLES, (unsigned int)indices.size(), GL_UNSIGNED_INT, indices.data());
+void Icosphere::disableVertexArrays(bool buffered) const
+{
+    if(vertexFormat == VERTEX_COMPACT)
+    {
+        compactVertices.endDraw();
+    }
+    else
+    {
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    }
+    if(buffered)
+        MeshBuffers::unbind();
 
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_NORMAL_ARRAY);
-    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    if(isWelded())
+        glPopAttrib();
 }
 
 
@@ -116,6 +364,7 @@ void Icosphere::draw() const
 ///////////////////////////////////////////////////////////////////////////////
 void Icosphere::drawLines(const float lineColor[4]) const
 {
+    update();
     // set line colour
     glColor4fv(lineColor);
     glMaterialfv(GL_FRONT, GL_DIFFUSE,   lineColor);
@@ -123,18 +372,47 @@ void Icosphere::drawLines(const float lineColor[4]) const
     // draw lines with VA
     glDisable(GL_LIGHTING);
     glDisable(GL_TEXTURE_2D);
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glVertexPointer(3, GL_FLOAT, 0, vertices.data());
-
-    glDrawElements(GL_LINES, (unsigned int)lineIndices.size(), GL_UNSIGNED_INT, lineIndices.data());
-
-    glDisableClientState(GL_VERTEX_ARRAY);
+    bool buffered = beginDrawLines();
+    glDrawElements(GL_LINES, getLineIndexCount(), getIndexType(), buffered ? 0 : getLineIndexData());
+    endDrawLines(buffered);
     glEnable(GL_LIGHTING);
     glEnable(GL_TEXTURE_2D);
 }
 
 
 
+///////////////////////////////////////////////////////////////////////////////
+// bind the line indices and enable the vertex array only
+// The caller draws GL_LINES in between with lighting off, once or per copy.
+///////////////////////////////////////////////////////////////////////////////
+bool Icosphere::beginDrawLines() const
+{
+    update();
+    bool buffered = bindBuffers(true);
+    if(vertexFormat == VERTEX_COMPACT)
+    {
+        compactVertices.beginDraw(buffered);
+    }
+    else
+    {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(3, GL_FLOAT, interleavedStride, buffered ? 0 : &interleavedVertices[0]);
+    }
+    return buffered;
+}
+
+void Icosphere::endDrawLines(bool buffered) const
+{
+    if(vertexFormat == VERTEX_COMPACT)
+        compactVertices.endDraw();
+    else
+        glDisableClientState(GL_VERTEX_ARRAY);
+    if(buffered)
+        MeshBuffers::unbind();
+}
+
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // draw a icosphere surfaces and lines on top of it
 // the caller must set the line width before call this
@@ -157,21 +435,38 @@ void Icosphere::drawWithLines(const float lineColor[4]) const
 ///////////////////////////////////////////////////////////////////////////////
 void Icosphere::updateRadius()
 {
-    float scale = computeScaleForLength(&vertices[0], radius);
+    // no float position left to measure, rebuild on next access
+    if(singleStorage && vertexFormat == VERTEX_COMPACT)
+    {
+        dirty = true;
+        return;
+    }
 
-    std::size_t i, j;
-    std::size_t count = vertices.size();
-    for(i = 0, j = 0; i < count; i += 3, j += 8)
+    const float* v = singleStorage ? &interleavedVertices[0] : &vertices[0];
+    float scale = computeScaleForLength(v, radius);
+
+    std::size_t i;
+    std::size_t count = vertices.size();    // 0 in single storage mode
+    for(i = 0; i < count; ++i)
+        vertices[i] *= scale;
+
+    // for interleaved array
+    if(vertexFormat == VERTEX_FLOAT)
     {
-        vertices[i]   *= scale;
-        vertices[i+1] *= scale;
-        vertices[i+2] *= scale;
-
-        // for interleaved array
-        interleavedVertices[j]   *= scale;
-        interleavedVertices[j+1] *= scale;
-        interleavedVertices[j+2] *= scale;
+        count = interleavedVertices.size();
+        for(i = 0; i < count; i += 8)
+        {
+            interleavedVertices[i]   *= scale;
+            interleavedVertices[i+1] *= scale;
+            interleavedVertices[i+2] *= scale;
+        }
     }
+
+    // compact positions are relative, only the decode scale changes
+    if(vertexFormat == VERTEX_COMPACT)
+        compactVertices.scale(scale);
+    else
+        buffers.invalidateVertices(0, interleavedVertices.size() * sizeof(float));
 }
 
 
@@ -232,7 +527,489 @@ std::vector<float> Icosphere::computeIcosahedronVertices()
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// generate vertices with flat shading
+// compute 20 triangles of icosahedron with texture coords of the texture layout
+// Each face (v1-v2-v3) is 9 floats of faceVertices and 6 floats of
+// faceTexCoords, in the same order as buildVerticesFlat() adds them.
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::computeIcosahedronFaces(std::vector<float>& faceVertices, std::vector<float>& faceTexCoords)
+{
+    const float S_STEP = 186 / 2048.0f;     // horizontal texture step
+    const float T_STEP = 322 / 1024.0f;     // vertical texture step
+
+    std::vector<float> tmpVertices = computeIcosahedronVertices();
+    faceVertices.resize(20 * 9);
+    faceTexCoords.resize(20 * 6);
+
+    // 4 faces per iteration: 1st row, 2 in 2nd row, 3rd row
+    // vertex ids (0: top, 11: bottom, 1-5: 2nd row, 6-10: 3rd row) and
+    // texcoords in steps of (S_STEP, T_STEP) for each face corner
+    for(int i = 1; i <= 5; ++i)
+    {
+        int i2 = (i < 5) ? i + 1 : 1;
+        int i4 = (i < 5) ? i + 6 : 6;
+        const int ids[12] = { 0, i, i2,     i, i + 5, i2,     i2, i + 5, i4,     i + 5, 11, i4 };
+        const int ts[24] = { 2*i-1, 0,  2*i-2, 1,  2*i, 1,      // t0, t1, t2
+                             2*i-2, 1,  2*i-1, 2,  2*i, 1,      // t1, t3, t2
+                             2*i, 1,    2*i-1, 2,  2*i+1, 2,    // t2, t3, t4
+                             2*i-1, 2,  2*i, 3,    2*i+1, 2 };  // t3, t11, t4
+
+        int face = (i - 1) * 4;
+        for(int j = 0; j < 12; ++j)
+        {
+            float* v = &faceVertices[face * 9 + j * 3];
+            v[0] = tmpVertices[ids[j] * 3];
+            v[1] = tmpVertices[ids[j] * 3 + 1];
+            v[2] = tmpVertices[ids[j] * 3 + 2];
+            float* t = &faceTexCoords[face * 6 + j * 2];
+            t[0] = ts[j * 2] * S_STEP;
+            t[1] = ts[j * 2 + 1] * T_STEP;
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// build vertices with current build mode and shading
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::buildVertices()
+{
+    if(buildMode == DIRECT)
+        buildVerticesDirect();
+    else
+        buildVerticesSubdivided();
+
+    if(isWelded())
+        weldVertices();
+    if(optimized)
+        optimizeVertices();
+    packIndices();
+    if(vertexFormat == VERTEX_COMPACT)
+        buildCompactVertices();
+    if(singleStorage)
+        clearAttribArrays();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// subdivide icosahedron up to current level, starting from the finest cached
+// level of current shading that is not finer than it
+// Every level built on the way is added to the level cache.
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::buildVerticesSubdivided()
+{
+    int level = restoreLevel();
+    if(level < 0)
+    {
+        if(smooth)
+            buildVerticesSmooth();
+        else
+            buildVerticesFlat();
+        level = 0;
+        storeLevel(level);
+    }
+
+    while(level < subdivision)
+    {
+        if(smooth)
+            subdivideVerticesSmooth();
+        else
+            subdivideVerticesFlat();
+        storeLevel(++level);
+    }
+
+    // release the edge cache and seams, they are only needed for subdivision
+    std::vector<unsigned long long>().swap(edgeKeys);
+    std::vector<unsigned int>().swap(edgeValues);
+    std::vector<unsigned char>().swap(seamEdges);
+
+    // generate interleaved vertex array as well
+    buildInterleavedVertices();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// copy the finest cached level of current shading, not finer than current
+// subdivision, to vertex arrays, then return the level (-1 if none)
+///////////////////////////////////////////////////////////////////////////////
+int Icosphere::restoreLevel()
+{
+    std::list<LevelCacheEntry>::iterator found = levelCache.end();
+    for(std::list<LevelCacheEntry>::iterator it = levelCache.begin(); it != levelCache.end(); ++it)
+    {
+        if(it->smooth == smooth && it->level <= subdivision &&
+           (found == levelCache.end() || it->level > found->level))
+            found = it;
+    }
+    if(found == levelCache.end())
+        return -1;
+
+    // move to the front as the most recently used
+    levelCache.splice(levelCache.begin(), levelCache, found);
+
+    vertices = found->vertices;
+    normals = found->normals;
+    texCoords = found->texCoords;
+    indices = found->indices;
+    lineIndices = found->lineIndices;
+    seamEdges = found->seamEdges;
+
+    // the level may be built with other radius
+    if(found->radius != radius)
+    {
+        float scale = radius / found->radius;
+        for(std::size_t i = 0, count = vertices.size(); i < count; ++i)
+            vertices[i] *= scale;
+    }
+    return found->level;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// add a copy of vertex arrays of the level to the cache, then evict the least
+// recently used levels while the cache is larger than its capacity
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::storeLevel(int level)
+{
+    std::size_t size = (vertices.size() + normals.size() + texCoords.size()) * sizeof(float) +
+                       (indices.size() + lineIndices.size()) * sizeof(unsigned int) +
+                       seamEdges.size();
+    if(size > levelCacheSize)
+        return;
+
+    // replace the old copy of the same level
+    for(std::list<LevelCacheEntry>::iterator it = levelCache.begin(); it != levelCache.end(); ++it)
+    {
+        if(it->smooth == smooth && it->level == level)
+        {
+            levelCacheUsage -= it->size;
+            levelCache.erase(it);
+            break;
+        }
+    }
+
+    levelCache.push_front(LevelCacheEntry());
+    LevelCacheEntry& entry = levelCache.front();
+    entry.smooth = smooth;
+    entry.level = level;
+    entry.radius = radius;
+    entry.vertices = vertices;
+    entry.normals = normals;
+    entry.texCoords = texCoords;
+    entry.indices = indices;
+    entry.lineIndices = lineIndices;
+    entry.seamEdges = seamEdges;
+    entry.size = size;
+    levelCacheUsage += size;
+
+    trimLevelCache();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// evict the least recently used levels until the cache fits its capacity
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::trimLevelCache()
+{
+    while(levelCacheUsage > levelCacheSize && !levelCache.empty())
+    {
+        levelCacheUsage -= levelCache.back().size;
+        levelCache.pop_back();
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// set max # of bytes of the level cache, 0 disables it
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::setLevelCacheSize(std::size_t bytes)
+{
+    levelCacheSize = bytes;
+    trimLevelCache();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// tessellate each face of icosahedron directly into a barycentric grid of
+// (frequency + 1) rows, then project the grid points onto the sphere
+// There is no dependency between levels or faces, so all arrays are
+// allocated once and each face writes its own range with the indices computed
+// in closed form. Smooth shading shares the grid vertices within a face only.
+//          a               //
+//         / \              // row 0:   (0,0)
+//        *---*             // row 1:   (1,0) (1,1)
+//       / \ / \            //
+//      b---*---c           // row f:   (f,0) ... (f,f)
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::buildVerticesDirect()
+{
+    std::vector<float> faceVertices, faceTexCoords;
+    computeIcosahedronFaces(faceVertices, faceTexCoords);
+
+    // each side of a face is shared with another face, and only the lower
+    // face adds its lines, so that wireframe does not draw them twice
+    int sharedSides[20];
+    for(int face = 0; face < 20; ++face)
+        sharedSides[face] = findSharedSides(faceVertices, face);
+
+    // prefix sums of per-face counts are the offsets where each face writes,
+    // so faces can be built in any order or in parallel without locks
+    const std::size_t f = frequency;
+    std::size_t vertexOffsets[21], indexOffsets[21], lineIndexOffsets[21];
+    vertexOffsets[0] = indexOffsets[0] = lineIndexOffsets[0] = 0;
+    for(int face = 0; face < 20; ++face)
+    {
+        int skipped = (sharedSides[face] & 1) + (sharedSides[face] >> 1 & 1) + (sharedSides[face] >> 2 & 1);
+        vertexOffsets[face + 1] = vertexOffsets[face] + (smooth ? (f + 1) * (f + 2) / 2 : 3 * f * f);
+        indexOffsets[face + 1] = indexOffsets[face] + 3 * f * f;
+        lineIndexOffsets[face + 1] = lineIndexOffsets[face] + 3 * f * (f + 1)   // 3 edges per upward triangle
+                                   - 2 * f * skipped;                           // f edges per skipped side
+    }
+
+    // clear memory of prev arrays, then allocate exact sizes
+    std::vector<float>(vertexOffsets[20] * 3).swap(vertices);
+    std::vector<float>(vertexOffsets[20] * 3).swap(normals);
+    std::vector<float>(vertexOffsets[20] * 2).swap(texCoords);
+    std::vector<unsigned int>(indexOffsets[20]).swap(indices);
+    std::vector<unsigned int>(lineIndexOffsets[20]).swap(lineIndices);
+    std::vector<float>(vertexOffsets[20] * 8).swap(interleavedVertices);
+
+    // build a face and its interleaved vertices
+    std::atomic<int> nextFace(0);
+    auto buildFaces = [&]()
+    {
+        int face;
+        while((face = nextFace++) < 20)
+        {
+            buildFaceDirect(&faceVertices[face * 9], &faceTexCoords[face * 6], sharedSides[face],
+                            vertexOffsets[face], indexOffsets[face], lineIndexOffsets[face]);
+            interleaveVertices(vertexOffsets[face], vertexOffsets[face + 1]);
+        }
+    };
+
+    // run on worker threads if requested, the calling thread is one of them
+    int workerCount = std::min(getWorkerCount(), 20);
+    std::vector<std::thread> workers;
+    for(int i = 1; i < workerCount; ++i)
+        workers.push_back(std::thread(buildFaces));
+    buildFaces();
+    for(std::size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// return # of threads to build with
+// threadCount=0 uses all hardware threads
+///////////////////////////////////////////////////////////////////////////////
+int Icosphere::getWorkerCount() const
+{
+    if(threadCount > 0)
+        return threadCount;
+
+    int count = (int)std::thread::hardware_concurrency();
+    return (count > 0) ? count : 1;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// return the sides of a face shared with a lower face as bits
+// Side 0 is v1-v2 (k=0), side 1 is v2-v3 (r=f) and side 2 is v3-v1 (k=r).
+// Faces share the corners of icosahedron, so positions compare exactly.
+///////////////////////////////////////////////////////////////////////////////
+int Icosphere::findSharedSides(const std::vector<float>& faceVertices, int face)
+{
+    int sides = 0;
+    for(int side = 0; side < 3; ++side)
+    {
+        const float* a = &faceVertices[face * 9 + side * 3];
+        const float* b = &faceVertices[face * 9 + (side + 1) % 3 * 3];
+        for(int other = 0; other < face; ++other)
+        {
+            int found = 0;
+            for(int j = 0; j < 3; ++j)
+            {
+                const float* c = &faceVertices[other * 9 + j * 3];
+                if((c[0] == a[0] && c[1] == a[1] && c[2] == a[2]) ||
+                   (c[0] == b[0] && c[1] == b[1] && c[2] == b[2]))
+                    ++found;
+            }
+            if(found == 2)
+                sides |= 1 << side;
+        }
+    }
+    return sides;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// tessellate a face (v1-v2-v3) and write vertex attribs and indices starting
+// at the given offsets (in # of vertices and # of indices)
+// Triangles are added row by row; the upward triangle of (r,k) is
+// (r,k)-(r+1,k)-(r+1,k+1) and the downward is (r,k)-(r+1,k+1)-(r,k+1).
+// The lines of the sides in sharedSides are left to the lower face.
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::buildFaceDirect(const float fv[9], const float ft[6], int sharedSides, std::size_t vertexOffset,
+                                std::size_t indexOffset, std::size_t lineIndexOffset)
+{
+    const int f = frequency;
+    float* v = &vertices[vertexOffset * 3];
+    float* n = &normals[vertexOffset * 3];
+    float* t = &texCoords[vertexOffset * 2];
+    unsigned int* id = &indices[indexOffset];
+    unsigned int* line = &lineIndices[lineIndexOffset];
+    int r, k;
+
+    if(smooth)
+    {
+        // grid vertex (r,k) is at r*(r+1)/2 + k of this face
+        for(r = 0; r <= f; ++r)
+        {
+            for(k = 0; k <= r; ++k, v += 3, n += 3, t += 2)
+            {
+                computeGridVertex(fv, ft, r, k, v, t);
+                computeVertexNormal(v, n);
+            }
+        }
+
+        unsigned int base = (unsigned int)vertexOffset;
+        unsigned int i1, i2;                // first index of row r and r+1
+        for(r = 0; r < f; ++r)
+        {
+            i1 = base + r * (r + 1) / 2;
+            i2 = base + (r + 1) * (r + 2) / 2;
+            for(k = 0; k <= r; ++k, ++i1, ++i2)
+            {
+                *id++ = i1;     *id++ = i2;     *id++ = i2 + 1;
+                if(k < r)
+                {
+                    *id++ = i1; *id++ = i2 + 1; *id++ = i1 + 1;
+                }
+
+                // edges of upward triangle, except on shared sides
+                if(k > 0 || !(sharedSides & 1))
+                {
+                    *line++ = i1;   *line++ = i2;
+                }
+                if(r < f - 1 || !(sharedSides & 2))
+                {
+                    *line++ = i2;   *line++ = i2 + 1;
+                }
+                if(k < r || !(sharedSides & 4))
+                {
+                    *line++ = i2 + 1;   *line++ = i1;
+                }
+            }
+        }
+    }
+    else
+    {
+        float v1[3], v2[3], v3[3], v4[3];   // (r,k), (r+1,k), (r+1,k+1), (r,k+1)
+        float t1[2], t2[2], t3[2], t4[2];
+        float normal[3];
+        unsigned int index = (unsigned int)vertexOffset;
+        for(r = 0; r < f; ++r)
+        {
+            for(k = 0; k <= r; ++k)
+            {
+                computeGridVertex(fv, ft, r, k, v1, t1);
+                computeGridVertex(fv, ft, r + 1, k, v2, t2);
+                computeGridVertex(fv, ft, r + 1, k + 1, v3, t3);
+
+                // upward triangle
+                computeFaceNormal(v1, v2, v3, normal);
+                copyTriangleAttribs(v1, v2, v3, normal, t1, t2, t3, v, n, t);
+                v += 9;     n += 9;     t += 6;
+                *id++ = index;  *id++ = index + 1;  *id++ = index + 2;
+                if(k > 0 || !(sharedSides & 1))
+                {
+                    *line++ = index;    *line++ = index + 1;
+                }
+                if(r < f - 1 || !(sharedSides & 2))
+                {
+                    *line++ = index + 1;    *line++ = index + 2;
+                }
+                if(k < r || !(sharedSides & 4))
+                {
+                    *line++ = index + 2;    *line++ = index;
+                }
+                index += 3;
+
+                // downward triangle
+                if(k < r)
+                {
+                    computeGridVertex(fv, ft, r, k + 1, v4, t4);
+                    computeFaceNormal(v1, v3, v4, normal);
+                    copyTriangleAttribs(v1, v3, v4, normal, t1, t3, t4, v, n, t);
+                    v += 9;     n += 9;     t += 6;
+                    *id++ = index;  *id++ = index + 1;  *id++ = index + 2;
+                    index += 3;
+                }
+            }
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// compute the grid point (r,k) of a face on the sphere and its texture coord
+// barycentric weights are (f-r)/f, (r-k)/f and k/f for v1, v2 and v3
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::computeGridVertex(const float fv[9], const float ft[6], int r, int k, float v[3], float t[2]) const
+{
+    float inv = 1.0f / frequency;
+    float w1 = (frequency - r) * inv;
+    float w2 = (r - k) * inv;
+    float w3 = k * inv;
+
+    v[0] = fv[0] * w1 + fv[3] * w2 + fv[6] * w3;
+    v[1] = fv[1] * w1 + fv[4] * w2 + fv[7] * w3;
+    v[2] = fv[2] * w1 + fv[5] * w2 + fv[8] * w3;
+    float scale = computeScaleForLength(v, radius);
+    v[0] *= scale;
+    v[1] *= scale;
+    v[2] *= scale;
+
+    t[0] = ft[0] * w1 + ft[2] * w2 + ft[4] * w3;
+    t[1] = ft[1] * w1 + ft[3] * w2 + ft[5] * w3;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// copy 3 vertices, a face normal and 3 tex coords of a flat triangle to the
+// given destinations (9, 9 and 6 floats)
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::copyTriangleAttribs(const float v1[3], const float v2[3], const float v3[3], const float n[3],
+                                    const float t1[2], const float t2[2], const float t3[2],
+                                    float* dstV, float* dstN, float* dstT)
+{
+    for(int i = 0; i < 3; ++i)
+    {
+        dstV[i] = v1[i];
+        dstV[i + 3] = v2[i];
+        dstV[i + 6] = v3[i];
+        dstN[i] = dstN[i + 3] = dstN[i + 6] = n[i];
+    }
+    dstT[0] = t1[0];    dstT[1] = t1[1];
+    dstT[2] = t2[0];    dstT[3] = t2[1];
+    dstT[4] = t3[0];    dstT[5] = t3[1];
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// generate vertices of icosahedron (level 0) with flat shading
 // each triangle is independent (no shared vertices)
 ///////////////////////////////////////////////////////////////////////////////
 void Icosphere::buildVerticesFlat()
@@ -251,6 +1028,7 @@ void Icosphere::buildVerticesFlat()
     std::vector<float>().swap(texCoords);
     std::vector<unsigned int>().swap(indices);
     std::vector<unsigned int>().swap(lineIndices);
+    reserveArrays(60, 60, 60);  // 20 triangles of 3 vertices each, 30 edges
 
     const float *v0, *v1, *v2, *v3, *v4, *v11;          // vertex positions
     float n[3];                                         // face normal
@@ -334,18 +1112,12 @@ void Icosphere::buildVerticesFlat()
         // next index
         index += 12;
     }
-
-    // subdivide icosahedron
-    subdivideVerticesFlat();
-
-    // generate interleaved vertex array as well
-    buildInterleavedVertices();
 }
 
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// generate vertices with smooth shading
+// generate vertices of icosahedron (level 0) with smooth shading
 // NOTE: The north and south pole vertices cannot be shared for smooth shading
 // because they have same position and normal, but different texcoords per face
 // And, the first vertex on each row is also not shared.
@@ -368,7 +1140,7 @@ void Icosphere::buildVerticesSmooth()
     std::vector<float>().swap(texCoords);
     std::vector<unsigned int>().swap(indices);
     std::vector<unsigned int>().swap(lineIndices);
-    std::map<std::pair<float, float>, unsigned int>().swap(sharedIndices);
+    reserveArrays(22, 60, 60);  // 22 vertices, 20 triangles and 30 edges
 
     float v[3];                             // vertex
     float n[3];                             // normal
@@ -453,14 +1225,12 @@ void Icosphere::buildVerticesSmooth()
     addVertex(v[0], v[1], v[2]);
     addNormal(n[0], n[1], n[2]);
     addTexCoord(S_STEP * 2, T_STEP);
-    sharedIndices[std::make_pair(S_STEP * 2, T_STEP)] = texCoords.size() / 2 - 1;
 
     v[0] = tmpVertices[9];  v[1] = tmpVertices[10]; v[2] = tmpVertices[11]; // v15 (shared)
     Icosphere::computeVertexNormal(v, n);
     addVertex(v[0], v[1], v[2]);
     addNormal(n[0], n[1], n[2]);
     addTexCoord(S_STEP * 4, T_STEP);
-    sharedIndices[std::make_pair(S_STEP * 4, T_STEP)] = texCoords.size() / 2 - 1;
 
     v[0] = tmpVertices[12]; v[1] = tmpVertices[13]; v[2] = tmpVertices[14]; // v16 (shared)
     scale = Icosphere::computeScaleForLength(v, 1);
@@ -468,42 +1238,36 @@ void Icosphere::buildVerticesSmooth()
     addVertex(v[0], v[1], v[2]);
     addNormal(n[0], n[1], n[2]);
     addTexCoord(S_STEP * 6, T_STEP);
-    sharedIndices[std::make_pair(S_STEP * 6, T_STEP)] = texCoords.size() / 2 - 1;
 
     v[0] = tmpVertices[15]; v[1] = tmpVertices[16]; v[2] = tmpVertices[17]; // v17 (shared)
     Icosphere::computeVertexNormal(v, n);
     addVertex(v[0], v[1], v[2]);
     addNormal(n[0], n[1], n[2]);
     addTexCoord(S_STEP * 8, T_STEP);
-    sharedIndices[std::make_pair(S_STEP * 8, T_STEP)] = texCoords.size() / 2 - 1;
 
     v[0] = tmpVertices[21]; v[1] = tmpVertices[22]; v[2] = tmpVertices[23]; // v18 (shared)
     Icosphere::computeVertexNormal(v, n);
     addVertex(v[0], v[1], v[2]);
     addNormal(n[0], n[1], n[2]);
     addTexCoord(S_STEP * 3, T_STEP * 2);
-    sharedIndices[std::make_pair(S_STEP * 3, T_STEP * 2)] = texCoords.size() / 2 - 1;
 
     v[0] = tmpVertices[24]; v[1] = tmpVertices[25]; v[2] = tmpVertices[26]; // v19 (shared)
     Icosphere::computeVertexNormal(v, n);
     addVertex(v[0], v[1], v[2]);
     addNormal(n[0], n[1], n[2]);
     addTexCoord(S_STEP * 5, T_STEP * 2);
-    sharedIndices[std::make_pair(S_STEP * 5, T_STEP * 2)] = texCoords.size() / 2 - 1;
 
     v[0] = tmpVertices[27]; v[1] = tmpVertices[28]; v[2] = tmpVertices[29]; // v20 (shared)
     Icosphere::computeVertexNormal(v, n);
     addVertex(v[0], v[1], v[2]);
     addNormal(n[0], n[1], n[2]);
     addTexCoord(S_STEP * 7, T_STEP * 2);
-    sharedIndices[std::make_pair(S_STEP * 7, T_STEP * 2)] = texCoords.size() / 2 - 1;
 
     v[0] = tmpVertices[30]; v[1] = tmpVertices[31]; v[2] = tmpVertices[32]; // v21 (shared)
     Icosphere::computeVertexNormal(v, n);
     addVertex(v[0], v[1], v[2]);
     addNormal(n[0], n[1], n[2]);
     addTexCoord(S_STEP * 9, T_STEP * 2);
-    sharedIndices[std::make_pair(S_STEP * 9, T_STEP * 2)] = texCoords.size() / 2 - 1;
 
     // build index list for icosahedron (20 triangles)
     addIndices( 0, 10, 14);      // 1st row (5 tris)
@@ -527,6 +1291,15 @@ void Icosphere::buildVerticesSmooth()
     addIndices( 8, 21, 20);
     addIndices( 9, 13, 21);
 
+    // texture seams of each triangle, the edges to the pole vertices (00-09)
+    // and the left/right edges (10-12, 11-13) are on the seam
+    const unsigned char SEAMS[20] = { SEAM_12 | SEAM_31, SEAM_12 | SEAM_31, SEAM_12 | SEAM_31,     // 1st row
+                                      SEAM_12 | SEAM_31, SEAM_12 | SEAM_31,
+                                      SEAM_12, 0, 0, 0, 0, 0, 0, 0, 0, SEAM_23,                     // 2nd row
+                                      SEAM_12 | SEAM_31, SEAM_12 | SEAM_31, SEAM_12 | SEAM_31,     // 3rd row
+                                      SEAM_12 | SEAM_31, SEAM_12 | SEAM_31 };
+    seamEdges.assign(SEAMS, SEAMS + 20);
+
     // add edge lines of icosahedron
     lineIndices.push_back(0);   lineIndices.push_back(10);       // 00 - 10
     lineIndices.push_back(1);   lineIndices.push_back(14);       // 01 - 14
@@ -558,19 +1331,12 @@ void Icosphere::buildVerticesSmooth()
     lineIndices.push_back(7);   lineIndices.push_back(19);       // 07 - 19
     lineIndices.push_back(8);   lineIndices.push_back(20);       // 08 - 20
     lineIndices.push_back(9);   lineIndices.push_back(21);       // 09 - 21
-
-    // subdivide icosahedron
-    subdivideVerticesSmooth();
-
-    // generate interleaved vertex array as well
-    buildInterleavedVertices();
 }
 
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// divide a trinage into 4 sub triangles and repeat N times
-// If subdivision=0, do nothing.
+// divide each trinage into 4 sub triangles (one level)
 ///////////////////////////////////////////////////////////////////////////////
 void Icosphere::subdivideVerticesFlat()
 {
@@ -584,74 +1350,68 @@ void Icosphere::subdivideVerticesFlat()
     float newT1[2], newT2[2], newT3[2]; // new texture coords
     float normal[3];                    // new face normal
     unsigned int index = 0;             // new index value
-    int i, j;
+    int j;
 
-    // iteration
-    for(i = 1; i <= subdivision; ++i)
+    // move prev arrays out instead of copying them
+    tmpVertices.swap(vertices);
+    tmpTexCoords.swap(texCoords);
+    tmpIndices.swap(indices);
+
+    // each triangle becomes 4 triangles with own 3 vertices and 7 lines,
+    // so allocate exact sizes once
+    indexCount = (int)tmpIndices.size();
+    std::vector<float>().swap(normals);
+    std::vector<unsigned int>().swap(lineIndices);
+    reserveArrays(indexCount * 4, indexCount * 4, indexCount / 3 * 14);
+
+    for(j = 0; j < indexCount; j += 3)
     {
-        // copy prev arrays
-        tmpVertices = vertices;
-        tmpTexCoords = texCoords;
-        tmpIndices = indices;
-
-        // clear prev arrays
-        vertices.clear();
-        normals.clear();
-        texCoords.clear();
-        indices.clear();
-        lineIndices.clear();
-
-        index = 0;
-        indexCount = (int)tmpIndices.size();
-        for(j = 0; j < indexCount; j += 3)
-        {
-            // get 3 vertice and texcoords of a triangle
-            v1 = &tmpVertices[tmpIndices[j] * 3];
-            v2 = &tmpVertices[tmpIndices[j + 1] * 3];
-            v3 = &tmpVertices[tmpIndices[j + 2] * 3];
-            t1 = &tmpTexCoords[tmpIndices[j] * 2];
-            t2 = &tmpTexCoords[tmpIndices[j + 1] * 2];
-            t3 = &tmpTexCoords[tmpIndices[j + 2] * 2];
-
-            // get 3 new vertices by spliting half on each edge
-            computeHalfVertex(v1, v2, radius, newV1);
-            computeHalfVertex(v2, v3, radius, newV2);
-            computeHalfVertex(v1, v3, radius, newV3);
-            computeHalfTexCoord(t1, t2, newT1);
-            computeHalfTexCoord(t2, t3, newT2);
-            computeHalfTexCoord(t1, t3, newT3);
-
-            // add 4 new triangles
-            addVertices(v1, newV1, newV3);
-            addTexCoords(t1, newT1, newT3);
-            computeFaceNormal(v1, newV1, newV3, normal);
-            addNormals(normal, normal, normal);
-            addIndices(index, index+1, index+2);
-
-            addVertices(newV1, v2, newV2);
-            addTexCoords(newT1, t2, newT2);
-            computeFaceNormal(newV1, v2, newV2, normal);
-            addNormals(normal, normal, normal);
-            addIndices(index+3, index+4, index+5);
-
-            addVertices(newV1, newV2, newV3);
-            addTexCoords(newT1, newT2, newT3);
-            computeFaceNormal(newV1, newV2, newV3, normal);
-            addNormals(normal, normal, normal);
-            addIndices(index+6, index+7, index+8);
-
-            addVertices(newV3, newV2, v3);
-            addTexCoords(newT3, newT2, t3);
-            computeFaceNormal(newV3, newV2, v3, normal);
-            addNormals(normal, normal, normal);
-            addIndices(index+9, index+10, index+11);
-
-            // add new line indices per iteration
-            addSubLineIndices(index, index+1, index+4, index+5, index+11, index+9); //CCW
-
-            // next index
-            index += 12;
-        }
+        // get 3 vertice and texcoords of a triangle
+        v1 = &tmpVertices[tmpIndices[j] * 3];
+        v2 = &tmpVertices[tmpIndices[j + 1] * 3];
+        v3 = &tmpVertices[tmpIndices[j + 2] * 3];
+        t1 = &tmpTexCoords[tmpIndices[j] * 2];
+        t2 = &tmpTexCoords[tmpIndices[j + 1] * 2];
+        t3 = &tmpTexCoords[tmpIndices[j + 2] * 2];
+
+        // get 3 new vertices by spliting half on each edge
+        computeHalfVertex(v1, v2, radius, newV1);
+        computeHalfVertex(v2, v3, radius, newV2);
+        computeHalfVertex(v1, v3, radius, newV3);
+        computeHalfTexCoord(t1, t2, newT1);
+        computeHalfTexCoord(t2, t3, newT2);
+        computeHalfTexCoord(t1, t3, newT3);
+
+        // add 4 new triangles
+        addVertices(v1, newV1, newV3);
+        addTexCoords(t1, newT1, newT3);
+        computeFaceNormal(v1, newV1, newV3, normal);
+        addNormals(normal, normal, normal);
+        addIndices(index, index+1, index+2);
+
+        addVertices(newV1, v2, newV2);
+        addTexCoords(newT1, t2, newT2);
+        computeFaceNormal(newV1, v2, newV2, normal);
+        addNormals(normal, normal, normal);
+        addIndices(index+3, index+4, index+5);
+
+        addVertices(newV1, newV2, newV3);
+        addTexCoords(newT1, newT2, newT3);
+        computeFaceNormal(newV1, newV2, newV3, normal);
+        addNormals(normal, normal, normal);
+        addIndices(index+6, index+7, index+8);
+
+        addVertices(newV3, newV2, v3);
+        addTexCoords(newT3, newT2, t3);
+        computeFaceNormal(newV3, newV2, v3, normal);
+        addNormals(normal, normal, normal);
+        addIndices(index+9, index+10, index+11);
+
+        // add new line indices per iteration
+        addSubLineIndices(index, index+1, index+4, index+5, index+11, index+9); //CCW
+
+        // next index
+        index += 12;
     }
 }
 
@@ -659,8 +1419,7 @@ void Icosphere::subdivideVerticesFlat()
 
 ///////////////////////////////////////////////////////////////////////////////
 // divide a trianlge (v1-v2-v3) into 4 sub triangles by adding middle vertices
-// (newV1, newV2, newV3) and repeat N times
-// If subdivision=0, do nothing.
+// (newV1, newV2, newV3) (one level)
 //         v1           //
 //        / \           //
 // newV1 *---* newV3    //
@@ -671,68 +1430,65 @@ void Icosphere::subdivideVerticesFlat()
 void Icosphere::subdivideVerticesSmooth()
 {
     std::vector<unsigned int> tmpIndices;
+    std::vector<unsigned char> tmpSeams;
     int indexCount;
     unsigned int i1, i2, i3;            // indices from original triangle
-    const float *v1, *v2, *v3;          // ptr to original vertices of a triangle
-    const float *t1, *t2, *t3;          // ptr to original texcoords of a triangle
-    float newV1[3], newV2[3], newV3[3]; // new subdivided vertex positions
-    float newN1[3], newN2[3], newN3[3]; // new subdivided normals
-    float newT1[2], newT2[2], newT3[2]; // new subdivided texture coords
     unsigned int newI1, newI2, newI3;   // new subdivided indices
-    int i, j;
-
-    // iteration for subdivision
-    for(i = 1; i <= subdivision; ++i)
+    unsigned char seams;                // seam flags of original triangle
+    int j;
+
+    // move prev indices and seams out instead of copying them
+    tmpIndices.swap(indices);
+    tmpSeams.swap(seamEdges);
+
+    // each triangle has 3 edges and an inner edge is shared by 2 triangles,
+    // so this level has about 3/2 edges per triangle
+    indexCount = (int)tmpIndices.size();
+    resetEdgeCache(indexCount / 2);
+
+    // a shared edge gets 1 new vertex, but a seam edge gets 1 on each side,
+    // so # of new vertices = (3 * triangles + seam edges) / 2
+    std::size_t seamCount = 0;
+    for(std::size_t i = 0, count = tmpSeams.size(); i < count; ++i)
     {
-        // copy prev indices
-        tmpIndices = indices;
+        seamCount += ((tmpSeams[i] & SEAM_12) != 0) + ((tmpSeams[i] & SEAM_23) != 0) +
+                     ((tmpSeams[i] & SEAM_31) != 0);
+    }
+    std::size_t vertexCount = vertices.size() / 3 + (indexCount + seamCount) / 2;
 
-        // clear prev arrays
-        indices.clear();
-        lineIndices.clear();
+    // allocate exact sizes once
+    std::vector<unsigned int>().swap(lineIndices);
+    reserveArrays(vertexCount, indexCount * 4, indexCount / 3 * 14);
+    seamEdges.reserve(indexCount / 3 * 4);
 
-        indexCount = (int)tmpIndices.size();
-        for(j = 0; j < indexCount; j += 3)
-        {
-            // get 3 indices of each triangle
-            i1 = tmpIndices[j];
-            i2 = tmpIndices[j+1];
-            i3 = tmpIndices[j+2];
-
-            // get 3 vertex attribs from prev triangle
-            v1 = &vertices[i1 * 3];
-            v2 = &vertices[i2 * 3];
-            v3 = &vertices[i3 * 3];
-            t1 = &texCoords[i1 * 2];
-            t2 = &texCoords[i2 * 2];
-            t3 = &texCoords[i3 * 2];
-
-            // get 3 new vertex attribs by spliting half on each edge
-            computeHalfVertex(v1, v2, radius, newV1);
-            computeHalfVertex(v2, v3, radius, newV2);
-            computeHalfVertex(v1, v3, radius, newV3);
-            computeHalfTexCoord(t1, t2, newT1);
-            computeHalfTexCoord(t2, t3, newT2);
-            computeHalfTexCoord(t1, t3, newT3);
-            computeVertexNormal(newV1, newN1);
-            computeVertexNormal(newV2, newN2);
-            computeVertexNormal(newV3, newN3);
-
-            // add new vertices/normals/texcoords to arrays
-            // It will check if it is shared/non-shared and return index
-            newI1 = addSubVertexAttribs(newV1, newN1, newT1);
-            newI2 = addSubVertexAttribs(newV2, newN2, newT2);
-            newI3 = addSubVertexAttribs(newV3, newN3, newT3);
-
-            // add 4 new triangle indices
-            addIndices(i1, newI1, newI3);
-            addIndices(newI1, i2, newI2);
-            addIndices(newI1, newI2, newI3);
-            addIndices(newI3, newI2, i3);
-
-            // add new line indices
-            addSubLineIndices(i1, newI1, i2, newI2, i3, newI3); //CCW
-        }
+    for(j = 0; j < indexCount; j += 3)
+    {
+        // get 3 indices of each triangle
+        i1 = tmpIndices[j];
+        i2 = tmpIndices[j+1];
+        i3 = tmpIndices[j+2];
+        seams = tmpSeams[j / 3];
+
+        // add new vertex attribs by spliting half on each edge
+        // the middle vertex of a seam edge is not shared
+        newI1 = addSubVertexAttribs(i1, i2, (seams & SEAM_12) != 0);
+        newI2 = addSubVertexAttribs(i2, i3, (seams & SEAM_23) != 0);
+        newI3 = addSubVertexAttribs(i1, i3, (seams & SEAM_31) != 0);
+
+        // add 4 new triangle indices
+        addIndices(i1, newI1, newI3);
+        addIndices(newI1, i2, newI2);
+        addIndices(newI1, newI2, newI3);
+        addIndices(newI3, newI2, i3);
+
+        // half edges keep the seam flag of the parent edge, inner edges are not seams
+        seamEdges.push_back(seams & (SEAM_12 | SEAM_31));
+        seamEdges.push_back((seams & SEAM_12) | (seams & SEAM_23));
+        seamEdges.push_back(0);
+        seamEdges.push_back((seams & SEAM_23) | (seams & SEAM_31));
+
+        // add new line indices
+        addSubLineIndices(i1, newI1, i2, newI2, i3, newI3); //CCW
     }
 }
 
@@ -744,22 +1500,141 @@ void Icosphere::subdivideVerticesSmooth()
 ///////////////////////////////////////////////////////////////////////////////
 void Icosphere::buildInterleavedVertices()
 {
+    std::vector<float>(vertices.size() / 3 * 8).swap(interleavedVertices);
+    interleaveVertices(0, vertices.size() / 3);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// share vertices of flat shading between triangles
+// Each triangle keeps its face normal on its provoking (last) vertex, which
+// GL_FLAT uses for the whole triangle, so the vertex count drops to about
+// the triangle count instead of 3 times of it.
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::weldVertices()
+{
+    flatVertexCount = (unsigned int)vertices.size() / 3;
+    std::vector<unsigned int> remap = MeshOptimizer::weldFlatVertices(vertices, normals, texCoords, indices);
+    MeshOptimizer::remapIndices(lineIndices, remap);
+    buildInterleavedVertices();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// reorder triangles for vertex cache, then renumber vertices for fetch
+// locality, and remap all attribute arrays and line indices accordingly
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::optimizeVertices()
+{
+    std::size_t vertexCount = vertices.size() / 3;
+    cacheStatsBefore = MeshOptimizer::analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+
+    MeshOptimizer::optimizeVertexCache(indices.data(), indices.size(), vertexCount);
+    std::vector<unsigned int> remap = MeshOptimizer::optimizeVertexFetch(indices.data(), indices.size(), vertexCount);
+    MeshOptimizer::remapIndices(lineIndices, remap);
+    MeshOptimizer::remapAttribs(vertices, 3, remap);
+    MeshOptimizer::remapAttribs(normals, 3, remap);
+    MeshOptimizer::remapAttribs(texCoords, 2, remap);
+    buildInterleavedVertices();
+
+    cacheStatsAfter = MeshOptimizer::analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// store indices in 16 bits if all vertices are addressable, then free the
+// 32-bit arrays
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::packIndices()
+{
+    std::vector<unsigned short>().swap(shortIndices);
+    std::vector<unsigned short>().swap(shortLineIndices);
+    shortIndex = vertices.size() / 3 <= 65536;
+    if(!shortIndex)
+        return;
+
+    shortIndices.assign(indices.begin(), indices.end());
+    shortLineIndices.assign(lineIndices.begin(), lineIndices.end());
+    std::vector<unsigned int>().swap(indices);
+    std::vector<unsigned int>().swap(lineIndices);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// return GL type of indices
+///////////////////////////////////////////////////////////////////////////////
+unsigned int Icosphere::getIndexType() const
+{
+    update();
+    return shortIndex ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// quantize interleaved vertices to 16-byte records, then free the float array
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::buildCompactVertices()
+{
+    compactVertices.build(interleavedVertices.data(), interleavedVertices.size() / 8);
     std::vector<float>().swap(interleavedVertices);
+    interleavedStride = compactVertices.getStride();
+    buffers.invalidate();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// release separate vertex/normal/texcoord arrays for single storage mode
+// The interleaved (or compact) array is the only copy after this.
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::clearAttribArrays()
+{
+    std::vector<float>().swap(vertices);
+    std::vector<float>().swap(normals);
+    std::vector<float>().swap(texCoords);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// reserve exact capacity of the arrays for push_back, so a build allocates
+// each of them once
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::reserveArrays(std::size_t vertexCount, std::size_t indexCount, std::size_t lineIndexCount)
+{
+    vertices.reserve(vertexCount * 3);
+    normals.reserve(vertexCount * 3);
+    texCoords.reserve(vertexCount * 2);
+    indices.reserve(indexCount);
+    lineIndices.reserve(lineIndexCount);
+}
+
 
-    std::size_t i, j;
-    std::size_t count = vertices.size();
-    for(i = 0, j = 0; i < count; i += 3, j += 2)
+
+///////////////////////////////////////////////////////////////////////////////
+// copy V/N/T of vertices in [first, last) to the interleaved array
+// interleavedVertices must be already allocated for all vertices
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::interleaveVertices(std::size_t first, std::size_t last)
+{
+    float* dst = &interleavedVertices[first * 8];
+    for(std::size_t i = first * 3, j = first * 2; i < last * 3; i += 3, j += 2, dst += 8)
     {
-        interleavedVertices.push_back(vertices[i]);
-        interleavedVertices.push_back(vertices[i+1]);
-        interleavedVertices.push_back(vertices[i+2]);
+        dst[0] = vertices[i];
+        dst[1] = vertices[i+1];
+        dst[2] = vertices[i+2];
 
-        interleavedVertices.push_back(normals[i]);
-        interleavedVertices.push_back(normals[i+1]);
-        interleavedVertices.push_back(normals[i+2]);
+        dst[3] = normals[i];
+        dst[4] = normals[i+1];
+        dst[5] = normals[i+2];
 
-        interleavedVertices.push_back(texCoords[j]);
-        interleavedVertices.push_back(texCoords[j+1]);
+        dst[6] = texCoords[j];
+        dst[7] = texCoords[j+1];
     }
 }
 
@@ -897,42 +1772,40 @@ void Icosphere::addSubLineIndices(unsigned int i1,
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// add a subdivided vertex attribs (vertex, normal, texCoord) to arrays, then
-// return its index value
-// If it is a shared vertex, remember its index, so it can be re-used
+// add the middle vertex attribs (vertex, normal, texCoord) of edge (i1, i2) to
+// arrays, then return its index value
+// If it is a shared vertex, remember its index in the edge cache, so it is
+// computed once and re-used by the neighbour triangle. A seam edge belongs to
+// one triangle only, so its middle vertex is never looked up.
 ///////////////////////////////////////////////////////////////////////////////
-unsigned int Icosphere::addSubVertexAttribs(const float v[3], const float n[3], const float t[2])
+unsigned int Icosphere::addSubVertexAttribs(unsigned int i1, unsigned int i2, bool seam)
 {
-    unsigned int index;     // return value;
-
-    // check if is shared vertex or not first
-    if(Icosphere::isSharedTexCoord(t))
+    // find if the edge is already split
+    unsigned long long key = (i1 < i2) ? ((unsigned long long)i1 << 32 | i2)
+                                       : ((unsigned long long)i2 << 32 | i1);
+    std::size_t slot = 0;
+    if(!seam)
     {
-        // find if it does already exist in sharedIndices map using (s,t) key
-        // if not in the list, add the vertex attribs to arrays and return its index
-        // if exists, return the current index
-        std::pair<float, float> key = std::make_pair(t[0], t[1]);
-        std::map<std::pair<float, float>, unsigned int>::iterator iter = sharedIndices.find(key);
-        if(iter == sharedIndices.end())
-        {
-            addVertex(v[0], v[1], v[2]);
-            addNormal(n[0], n[1], n[2]);
-            addTexCoord(t[0], t[1]);
-            index = texCoords.size() / 2 - 1;
-            sharedIndices[key] = index;
-        }
-        else
-        {
-            index = iter->second;
-        }
+        slot = findEdge(key);
+        if(edgeKeys[slot] == key)
+            return edgeValues[slot];
     }
-    // not shared
-    else
+
+    float v[3], n[3], t[2];
+    computeHalfVertex(&vertices[i1 * 3], &vertices[i2 * 3], radius, v);
+    computeHalfTexCoord(&texCoords[i1 * 2], &texCoords[i2 * 2], t);
+    computeVertexNormal(v, n);
+
+    addVertex(v[0], v[1], v[2]);
+    addNormal(n[0], n[1], n[2]);
+    addTexCoord(t[0], t[1]);
+    unsigned int index = (unsigned int)texCoords.size() / 2 - 1;
+
+    // remember shared vertex only
+    if(!seam)
     {
-        addVertex(v[0], v[1], v[2]);
-        addNormal(n[0], n[1], n[2]);
-        addTexCoord(t[0], t[1]);
-        index = texCoords.size() / 2 - 1;
+        edgeKeys[slot] = key;
+        edgeValues[slot] = index;
     }
 
     return index;
@@ -940,6 +1813,38 @@ unsigned int Icosphere::addSubVertexAttribs(const float v[3], const float n[3],
 
 
 
+///////////////////////////////////////////////////////////////////////////////
+// allocate open-addressing hash table of edges for a subdivision pass
+// The capacity is the power of 2 at least twice of the edge count, so the load
+// factor stays below 0.5 and linear probing is short.
+///////////////////////////////////////////////////////////////////////////////
+void Icosphere::resetEdgeCache(std::size_t edgeCount)
+{
+    std::size_t capacity = 16;
+    while(capacity < edgeCount * 2)
+        capacity <<= 1;
+
+    edgeKeys.assign(capacity, EMPTY_EDGE);
+    edgeValues.resize(capacity);
+    edgeMask = capacity - 1;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// return the slot of the edge key, or the empty slot where it can be inserted
+///////////////////////////////////////////////////////////////////////////////
+std::size_t Icosphere::findEdge(unsigned long long key) const
+{
+    // Fibonacci hashing to spread sequential indices
+    std::size_t slot = (std::size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & edgeMask;
+    while(edgeKeys[slot] != key && edgeKeys[slot] != EMPTY_EDGE)
+        slot = (slot + 1) & edgeMask;
+    return slot;
+}
+
+
+
 
 // static functions ===========================================================
 ///////////////////////////////////////////////////////////////////////////////
@@ -950,33 +1855,10 @@ void Icosphere::computeFaceNormal(const float v1[3], const float v2[3], const fl
 {
     const float EPSILON = 0.000001f;
 
-    // default return value (0, 0, 0)
-    n[0] = n[1] = n[2] = 0;
-
-    // find 2 edge vectors: v1-v2, v1-v3
-    float ex1 = v2[0] - v1[0];
-    float ey1 = v2[1] - v1[1];
-    float ez1 = v2[2] - v1[2];
-    float ex2 = v3[0] - v1[0];
-    float ey2 = v3[1] - v1[1];
-    float ez2 = v3[2] - v1[2];
-
-    // cross product: e1 x e2
-    float nx, ny, nz;
-    nx = ey1 * ez2 - ez1 * ey2;
-    ny = ez1 * ex2 - ex1 * ez2;
-    nz = ex1 * ey2 - ey1 * ex2;
-
-    // normalize only if the length is > 0
-    float length = sqrtf(nx * nx + ny * ny + nz * nz);
-    if(length > EPSILON)
-    {
-        // normalize
-        float lengthInv = 1.0f / length;
-        n[0] = nx * lengthInv;
-        n[1] = ny * lengthInv;
-        n[2] = nz * lengthInv;
-    }
+    // cross product of 2 edge vectors: v1-v2, v1-v3
+    // then normalize only if the length is > 0, otherwise (0,0,0)
+    vec3 p1(v1);
+    normalize(cross(vec3(v2) - p1, vec3(v3) - p1), EPSILON).store(n);
 }
 
 
@@ -987,10 +1869,7 @@ void Icosphere::computeFaceNormal(const float v1[3], const float v2[3], const fl
 void Icosphere::computeVertexNormal(const float v[3], float normal[3])
 {
     // normalize
-    float scale = Icosphere::computeScaleForLength(v, 1);
-    normal[0] = v[0] * scale;
-    normal[1] = v[1] * scale;
-    normal[2] = v[2] * scale;
+    (vec3(v) * Icosphere::computeScaleForLength(v, 1)).store(normal);
 }
 
 
@@ -1001,7 +1880,7 @@ void Icosphere::computeVertexNormal(const float v[3], float normal[3])
 float Icosphere::computeScaleForLength(const float v[3], float length)
 {
     // and normalize the vector then re-scale to new radius
-    return length / sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    return length / vec3(v).length();
 }
 
 
@@ -1012,13 +1891,8 @@ float Icosphere::computeScaleForLength(const float v[3], float length)
 ///////////////////////////////////////////////////////////////////////////////
 void Icosphere::computeHalfVertex(const float v1[3], const float v2[3], float length, float newV[3])
 {
-    newV[0] = v1[0] + v2[0];
-    newV[1] = v1[1] + v2[1];
-    newV[2] = v1[2] + v2[2];
-    float scale = Icosphere::computeScaleForLength(newV, length);
-    newV[0] *= scale;
-    newV[1] *= scale;
-    newV[2] *= scale;
+    vec3 v = vec3(v1) + vec3(v2);
+    (v * (length / v.length())).store(newV);
 }
 
 
@@ -1031,79 +1905,3 @@ void Icosphere::computeHalfTexCoord(const float t1[2], const float t2[2], float
     newT[0] = (t1[0] + t2[0]) * 0.5f;
     newT[1] = (t1[1] + t2[1]) * 0.5f;
 }
-
-
-
-///////////////////////////////////////////////////////////////////////////////
-// This function used 20 non-shared line segments to determine if the given
-// texture coordinate is shared or no. If it is on the line segments, it is also
-// non-shared point
-//   00  01  02  03  04         //
-//   /\  /\  /\  /\  /\         //
-//  /  \/  \/  \/  \/  \        //
-// 05  06  07  08  09   \       //
-//   \   10  11  12  13  14     //
-//    \  /\  /\  /\  /\  /      //
-//     \/  \/  \/  \/  \/       //
-//      15  16  17  18  19      //
-///////////////////////////////////////////////////////////////////////////////
-bool Icosphere::isSharedTexCoord(const float t[2])
-{
-    // 20 non-shared line segments
-    const float S = 1.0f / 11;  // texture steps
-    const float T = 1.0f / 3;
-    static float segments[] = { S, 0,       0, T,       // 00 - 05
-                                S, 0,       S*2, T,     // 00 - 06
-                                S*3, 0,     S*2, T,     // 01 - 06
-                                S*3, 0,     S*4, T,     // 01 - 07
-                                S*5, 0,     S*4, T,     // 02 - 07
-                                S*5, 0,     S*6, T,     // 02 - 08
-                                S*7, 0,     S*6, T,     // 03 - 08
-                                S*7, 0,     S*8, T,     // 03 - 09
-                                S*9, 0,     S*8, T,     // 04 - 09
-                                S*9, 0,     1, T*2,     // 04 - 14
-                                0, T,       S*2, 1,     // 05 - 15
-                                S*3, T*2,   S*2, 1,     // 10 - 15
-                                S*3, T*2,   S*4, 1,     // 10 - 16
-                                S*5, T*2,   S*4, 1,     // 11 - 16
-                                S*5, T*2,   S*6, 1,     // 11 - 17
-                                S*7, T*2,   S*6, 1,     // 12 - 17
-                                S*7, T*2,   S*8, 1,     // 12 - 18
-                                S*9, T*2,   S*8, 1,     // 13 - 18
-                                S*9, T*2,   S*10, 1,    // 13 - 19
-                                1, T*2,     S*10, 1 };  // 14 - 19
-
-    // check the point with all 20 line segments
-    // if it is on the line segment, it is non-shared
-    int count = (int)(sizeof(segments) / sizeof(segments[0]));
-    for(int i = 0, j = 2; i < count; i+=4, j+=4)
-    {
-        if(Icosphere::isOnLineSegment(&segments[i], &segments[j], t))
-            return false;   // not shared
-    }
-
-    return true;
-}
-
-
-
-///////////////////////////////////////////////////////////////////////////////
-// determine a point c is on the line segment a-b
-///////////////////////////////////////////////////////////////////////////////
-bool Icosphere::isOnLineSegment(const float a[2], const float b[2], const float c[2])
-{
-    const float EPSILON = 0.0001f;
-
-    // cross product must be 0 if c is on the line
-    float cross = ((b[0] - a[0]) * (c[1] - a[1])) - ((b[1] - a[1]) * (c[0] - a[0]));
-    if(cross > EPSILON || cross < -EPSILON)
-        return false;
-
-    // c must be within a-b
-    if((c[0] > a[0] && c[0] > b[0]) || (c[0] < a[0] && c[0] < b[0]))
-        return false;
-    if((c[1] > a[1] && c[1] > b[1]) || (c[1] < a[1] && c[1] < b[1]))
-        return false;
-
-    return true;    // all passed, it is on the line segment
-}
@@ -2,13 +2,27 @@
 #define GEOMETRY_ICOSPHERE_H
 
 #include <vector>
-#include <map>
+#include <list>
+#include <cstddef>
+#include "CompactVertices.h"
+#include "MeshOptimizer.h"
+#include "Math3d.h"
+#include "MeshBuffers.h"
 
 class Icosphere
 {
 public:
+    // build modes
+    enum BuildMode
+    {
+        SUBDIVIDE = 0,                      // split triangles into 4 per subdivision
+        DIRECT                              // tessellate each face into a grid at once
+    };
+
     // ctor/dtor
-    Icosphere(float radius=1.0f, int subdivision=1, bool smooth=false);
+    // build=false defers the build to commit() or the first access, so that
+    // setters called right after construction do not build it twice
+    Icosphere(float radius=1.0f, int subdivision=1, bool smooth=false, bool build=true);
     ~Icosphere() {}
 
     // getters/setters
@@ -18,32 +32,89 @@ public:
     void setSubdivision(int subdivision);
     bool getSmooth() const                  { return smooth; }
     void setSmooth(bool smooth);
+    BuildMode getBuildMode() const          { return buildMode; }
+    void setBuildMode(BuildMode mode);
+    int getFrequency() const                { return frequency; }   // # of segments per edge
+    void setFrequency(int frequency);       // any frequency, switch to DIRECT
+    int getThreadCount() const              { return threadCount; }
+    void setThreadCount(int count);         // for DIRECT, 0 = all hardware threads
+    std::size_t getLevelCacheSize() const   { return levelCacheSize; }     // max # of bytes
+    void setLevelCacheSize(std::size_t bytes);  // 0 = no cache (default), opt in if the level changes
+    std::size_t getLevelCacheUsage() const  { return levelCacheUsage; }    // # of bytes in use
+
+    // setters only record parameters, the geometry is rebuilt once on the
+    // first access or draw; commit() pays the cost now
+    void commit();
+    unsigned int getRebuildCount() const    { return rebuildCount; }
 
     // for vertex data
-    unsigned int getVertexCount() const     { return (unsigned int)vertices.size() / 3; }
-    unsigned int getNormalCount() const     { return (unsigned int)normals.size() / 3; }
-    unsigned int getTexCoordCount() const   { return (unsigned int)texCoords.size() / 2; }
-    unsigned int getIndexCount() const      { return (unsigned int)indices.size(); }
-    unsigned int getLineIndexCount() const  { return (unsigned int)lineIndices.size(); }
+    // vertex/normal/texcoord arrays are empty in single storage mode
+    unsigned int getVertexCount() const;
+    unsigned int getNormalCount() const     { update(); return (unsigned int)normals.size() / 3; }
+    unsigned int getTexCoordCount() const   { update(); return (unsigned int)texCoords.size() / 2; }
+    unsigned int getIndexCount() const      { update(); return (unsigned int)(shortIndex ? shortIndices.size() : indices.size()); }
+    unsigned int getLineIndexCount() const  { update(); return (unsigned int)(shortIndex ? shortLineIndices.size() : lineIndices.size()); }
     unsigned int getTriangleCount() const   { return getIndexCount() / 3; }
 
-    unsigned int getVertexSize() const      { return (unsigned int)vertices.size() * sizeof(float); }   // # of bytes
-    unsigned int getNormalSize() const      { return (unsigned int)normals.size() * sizeof(float); }
-    unsigned int getTexCoordSize() const    { return (unsigned int)texCoords.size() * sizeof(float); }
-    unsigned int getIndexSize() const       { return (unsigned int)indices.size() * sizeof(unsigned int); }
-    unsigned int getLineIndexSize() const   { return (unsigned int)lineIndices.size() * sizeof(unsigned int); }
-
-    const float* getVertices() const        { return vertices.data(); }
-    const float* getNormals() const         { return normals.data(); }
-    const float* getTexCoords() const       { return texCoords.data(); }
-    const unsigned int* getIndices() const  { return indices.data(); }
-    const unsigned int* getLineIndices() const  { return lineIndices.data(); }
+    unsigned int getVertexSize() const      { update(); return (unsigned int)vertices.size() * sizeof(float); }   // # of bytes
+    unsigned int getNormalSize() const      { update(); return (unsigned int)normals.size() * sizeof(float); }
+    unsigned int getTexCoordSize() const    { update(); return (unsigned int)texCoords.size() * sizeof(float); }
+    unsigned int getIndexSize() const       { return getIndexCount() * getIndexElementSize(); }
+    unsigned int getLineIndexSize() const   { return getLineIndexCount() * getIndexElementSize(); }
+
+    const float* getVertices() const        { update(); return vertices.data(); }
+    const float* getNormals() const         { update(); return normals.data(); }
+    const float* getTexCoords() const       { update(); return texCoords.data(); }
+    // typed index arrays return NULL if the indices are packed the other way,
+    // use getIndexData()/getLineIndexData() with getIndexType() instead
+    const unsigned int* getIndices() const  { update(); return shortIndex ? 0 : indices.data(); }          // 32-bit indices only
+    const unsigned int* getLineIndices() const  { update(); return shortIndex ? 0 : lineIndices.data(); }
+    const unsigned short* getShortIndices() const { update(); return shortIndex ? shortIndices.data() : 0; }   // 16-bit indices only
+    const unsigned short* getShortLineIndices() const { update(); return shortIndex ? shortLineIndices.data() : 0; }
+
+    // indices are 16-bit if # of vertices <= 65536, otherwise 32-bit
+    unsigned int getIndexType() const;      // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    unsigned int getIndexElementSize() const    { update(); return shortIndex ? sizeof(unsigned short) : sizeof(unsigned int); }
+    const void* getIndexData() const        { update(); return shortIndex ? (const void*)shortIndices.data() : (const void*)indices.data(); }
+    const void* getLineIndexData() const    { update(); return shortIndex ? (const void*)shortLineIndices.data() : (const void*)lineIndices.data(); }
 
     // for interleaved vertices: V/N/T
     unsigned int getInterleavedVertexCount() const  { return getVertexCount(); }    // # of vertices
-    unsigned int getInterleavedVertexSize() const   { return (unsigned int)interleavedVertices.size() * sizeof(float); }    // # of bytes
-    int getInterleavedStride() const                { return interleavedStride; }   // should be 32 bytes
-    const float* getInterleavedVertices() const     { return interleavedVertices.data(); }
+    unsigned int getInterleavedVertexSize() const;  // # of bytes
+    int getInterleavedStride() const                { update(); return interleavedStride; }   // 32 or 16 bytes
+    const float* getInterleavedVertices() const     { update(); return interleavedVertices.data(); }  // VERTEX_FLOAT only
+    VertexFormat getVertexFormat() const            { return vertexFormat; }
+    void setVertexFormat(VertexFormat format);
+    const CompactVertices& getCompactVertices() const { update(); return compactVertices; } // VERTEX_COMPACT only
+
+    // vertex cache and fetch optimization after build (off by default)
+    bool getOptimized() const               { return optimized; }
+    void setOptimized(bool optimized);
+    const VertexCacheStats& getCacheStatsBefore() const { update(); return cacheStatsBefore; }  // valid if optimized
+    const VertexCacheStats& getCacheStatsAfter() const  { update(); return cacheStatsAfter; }
+
+    // flat shading with shared vertices and the face normal on the provoking
+    // vertex, drawn with GL_FLAT (off by default)
+    bool getWelded() const                  { return welded; }
+    void setWelded(bool welded);
+    unsigned int getMemorySize() const;     // # of bytes of all vertex and index arrays
+
+    // keep the interleaved (or compact) array only and release the separate
+    // vertex/normal/texcoord arrays after build (off by default)
+    bool getSingleStorage() const           { return singleStorage; }
+    void setSingleStorage(bool single);
+
+    // draw from buffer objects uploaded once per build (see MeshBuffers),
+    // or from client arrays if they are not available
+    unsigned int getBufferUploadCount() const   { return buffers.getUploadCount(); }
+    void releaseBuffers()                   { buffers.release(); }    // GL context must be current
+
+    // set up the triangle arrays once to draw many copies (see InstanceBatch)
+    // return true if they are buffer objects, then indices are offsets
+    bool beginDraw() const;
+    void endDraw(bool buffered) const;
+    bool beginDrawLines() const;            // same for GL_LINES with getLineIndexData()
+    void endDrawLines(bool buffered) const;
 
     // draw in VertexArray mode
     void draw() const;
@@ -62,17 +133,42 @@ private:
     static float computeScaleForLength(const float v[3], float length);
     static void computeHalfVertex(const float v1[3], const float v2[3], float length, float newV[3]);
     static void computeHalfTexCoord(const float t1[2], const float t2[2], float newT[2]);
-    static bool isSharedTexCoord(const float t[2]);
-    static bool isOnLineSegment(const float a[2], const float b[2], const float c[2]);
+    static int findSharedSides(const std::vector<float>& faceVertices, int face);
+    static void copyTriangleAttribs(const float v1[3], const float v2[3], const float v3[3], const float n[3],
+                                    const float t1[2], const float t2[2], const float t3[2],
+                                    float* dstV, float* dstN, float* dstT);
 
     // member functions
     void updateRadius();
     std::vector<float> computeIcosahedronVertices();
+    void computeIcosahedronFaces(std::vector<float>& faceVertices, std::vector<float>& faceTexCoords);
+    void buildVertices();
+    void buildVerticesSubdivided();
+    int restoreLevel();
+    void storeLevel(int level);
+    void trimLevelCache();
+    void buildVerticesDirect();
+    void buildFaceDirect(const float fv[9], const float ft[6], int sharedSides, std::size_t vertexOffset,
+                         std::size_t indexOffset, std::size_t lineIndexOffset);
+    void computeGridVertex(const float fv[9], const float ft[6], int r, int k, float v[3], float t[2]) const;
     void buildVerticesFlat();
     void buildVerticesSmooth();
     void subdivideVerticesFlat();
     void subdivideVerticesSmooth();
     void buildInterleavedVertices();
+    void buildCompactVertices();
+    void clearAttribArrays();
+    void reserveArrays(std::size_t vertexCount, std::size_t indexCount, std::size_t lineIndexCount);
+    void update() const                     { if(dirty) const_cast<Icosphere*>(this)->commit(); }
+    void weldVertices();
+    void optimizeVertices();
+    bool isWelded() const                   { return welded && !smooth; }
+    void packIndices();
+    bool bindBuffers(bool lines) const;
+    void enableVertexArrays(bool buffered) const;
+    void disableVertexArrays(bool buffered) const;
+    void interleaveVertices(std::size_t first, std::size_t last);
+    int getWorkerCount() const;
     void addVertex(float x, float y, float z);
     void addVertices(const float v1[3], const float v2[3], const float v3[3]);
     void addNormal(float nx, float ny, float nz);
@@ -82,22 +178,74 @@ private:
     void addIndices(unsigned int i1, unsigned int i2, unsigned int i3);
     void addSubLineIndices(unsigned int i1, unsigned int i2, unsigned int i3,
                            unsigned int i4, unsigned int i5, unsigned int i6);
-    unsigned int addSubVertexAttribs(const float v[3], const float n[3], const float t[2]);
+    unsigned int addSubVertexAttribs(unsigned int i1, unsigned int i2, bool seam);
+    void resetEdgeCache(std::size_t edgeCount);
+    std::size_t findEdge(unsigned long long key) const;
 
     // memeber vars
     float radius;                           // circumscribed radius
     int subdivision;
     bool smooth;
+    BuildMode buildMode;
+    int frequency;                          // # of segments per edge for DIRECT mode
+    int threadCount;                        // # of threads for DIRECT mode
     std::vector<float> vertices;
     std::vector<float> normals;
     std::vector<float> texCoords;
     std::vector<unsigned int> indices;
     std::vector<unsigned int> lineIndices;
-    std::map<std::pair<float, float>, unsigned int> sharedIndices;   // indices of shared vertices, key is tex coord (s,t)
+    std::vector<unsigned short> shortIndices;        // packed indices if they fit in 16 bits
+    std::vector<unsigned short> shortLineIndices;
+    bool shortIndex;                        // true if indices are packed in 16 bits
+
+    // edge cache for subdivision, key is ordered pair of parent indices
+    std::vector<unsigned long long> edgeKeys;
+    std::vector<unsigned int> edgeValues;   // index of middle vertex
+    std::size_t edgeMask;                   // capacity - 1
+    std::vector<unsigned char> seamEdges;   // seam flags of edges per triangle
 
     // interleaved
     std::vector<float> interleavedVertices;
-    int interleavedStride;                  // # of bytes to hop to the next vertex (should be 32 bytes)
+    int interleavedStride;                  // # of bytes to hop to the next vertex (32 or 16 bytes)
+    VertexFormat vertexFormat;
+    CompactVertices compactVertices;        // quantized copy replacing interleavedVertices
+
+    // vertex cache optimization
+    bool optimized;
+    VertexCacheStats cacheStatsBefore;      // ACMR/ATVR of generated order
+    VertexCacheStats cacheStatsAfter;       // ACMR/ATVR after optimization
+
+    // welded flat shading
+    bool welded;
+    unsigned int flatVertexCount;           // # of vertices before welding
+
+    // vertex/normal/texcoord arrays are build scratch only
+    bool singleStorage;
+
+    // GPU copies of interleaved vertices and indices, uploaded on draw
+    MeshBuffers buffers;
+
+    // deferred rebuild
+    bool dirty;                             // parameters changed since last build
+    unsigned int rebuildCount;              // # of rebuilds performed
+
+    // built levels of SUBDIVIDE mode before post-processing, most recent first
+    struct LevelCacheEntry
+    {
+        bool smooth;
+        int level;
+        float radius;                       // radius when it was built
+        std::vector<float> vertices;
+        std::vector<float> normals;
+        std::vector<float> texCoords;
+        std::vector<unsigned int> indices;
+        std::vector<unsigned int> lineIndices;
+        std::vector<unsigned char> seamEdges;
+        std::size_t size;                   // # of bytes
+    };
+    std::list<LevelCacheEntry> levelCache;
+    std::size_t levelCacheSize;             // capacity in bytes
+    std::size_t levelCacheUsage;
 
 };
 
@@ -0,0 +1,369 @@
+///////////////////////////////////////////////////////////////////////////////
+// InstanceBatch.cpp
+// =================
+// copies of one unit mesh drawn together, each with its own position,
+// rotation, scale and color
+///////////////////////////////////////////////////////////////////////////////
+
+#define GL_SILENCE_DEPRECATION // silence deprecation warnings
+
+#ifdef _WIN32
+#include <windows.h>    // include windows.h to avoid thousands of compile errors even though this class is not depending on Windows
+#endif
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <OpenGL/glext.h>
+#else
+#define GL_GLEXT_PROTOTYPES     // shader and instancing functions are not in gl.h
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include "InstanceBatch.h"
+#include "Icosphere.h"
+#include "Cylinder.h"
+
+// no function loader for GL 2.0+ on Windows, same as MeshBuffers
+#ifndef _WIN32
+#define INSTANCING_SUPPORTED
+#endif
+
+// constants //////////////////////////////////////////////////////////////////
+// generic attributes not aliased with the vertex, normal and texcoord arrays
+const unsigned int POSITION_ATTRIB = 4;
+const unsigned int SCALE_ATTRIB    = 5;
+const unsigned int ROTATION_ATTRIB = 6;
+const unsigned int COLOR_ATTRIB    = 7;
+
+// per-vertex lighting of the fixed pipeline for a directional GL_LIGHT0, with
+// color material tracking ambient and diffuse, so it matches the batched
+// draws. The inverse transpose of rotate * scale is rotate * (1 / scale).
+// gl_FrontColor is flat shaded with GL_FLAT for welded meshes. The half
+// vector is computed for the default non-local viewer, gl_LightSource's
+// halfVector is not kept up to date by all drivers.
+const char* VERTEX_SHADER =
+    "#version 120\n"
+    "attribute vec3 instancePosition;\n"
+    "attribute vec3 instanceScale;\n"
+    "attribute vec4 instanceRotation;\n"
+    "attribute vec4 instanceColor;\n"
+    "vec3 rotate(vec4 q, vec3 v)\n"
+    "{\n"
+    "    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);\n"
+    "}\n"
+    "void main()\n"
+    "{\n"
+    "    vec3 position = rotate(instanceRotation, gl_Vertex.xyz * instanceScale) + instancePosition;\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(position, 1.0);\n"
+    "    vec3 normal = rotate(instanceRotation, gl_Normal / max(instanceScale, vec3(0.000001)));\n"
+    "    normal = normalize(gl_NormalMatrix * normal);\n"
+    "    vec3 light = normalize(gl_LightSource[0].position.xyz);\n"
+    "    float nDotL = max(dot(normal, light), 0.0);\n"
+    "    vec4 color = gl_FrontMaterial.emission + instanceColor * gl_LightModel.ambient\n"
+    "               + instanceColor * gl_LightSource[0].ambient\n"
+    "               + instanceColor * gl_LightSource[0].diffuse * nDotL;\n"
+    "    if(nDotL > 0.0)\n"
+    "    {\n"
+    "        float nDotH = max(dot(normal, normalize(light + vec3(0.0, 0.0, 1.0))), 0.0);\n"
+    "        color += gl_FrontMaterial.specular * gl_LightSource[0].specular * pow(nDotH, gl_FrontMaterial.shininess);\n"
+    "    }\n"
+    "    gl_FrontColor = vec4(color.rgb, instanceColor.a);\n"
+    "}\n";
+
+const char* FRAGMENT_SHADER =
+    "#version 120\n"
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = gl_Color;\n"
+    "}\n";
+
+namespace
+{
+    bool instancingEnabled = true;
+
+#ifdef INSTANCING_SUPPORTED
+    // true if the space-separated extension list has the name
+    bool hasExtension(const char* extensions, const char* name)
+    {
+        std::size_t length = strlen(name);
+        for(const char* p = extensions; p && (p = strstr(p, name)) != 0; p += length)
+        {
+            if((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+                return true;
+        }
+        return false;
+    }
+
+    GLuint compileShader(GLenum type, const char* source)
+    {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, 0);
+        glCompileShader(shader);
+
+        GLint status = 0;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if(!status)
+        {
+            char log[1024] = "";
+            glGetShaderInfoLog(shader, sizeof(log), 0, log);
+            std::cout << "[InstanceBatch] shader compile failed: " << log << std::endl;
+            glDeleteShader(shader);
+            return 0;
+        }
+        return shader;
+    }
+
+    // shared program, built once in the first context that draws
+    // Return 0 if it cannot be built, then batches are not instanced.
+    GLuint getProgram()
+    {
+        static int state = -1;              // -1: not built, 0: failed, 1: built
+        static GLuint program = 0;
+        if(state >= 0)
+            return program;
+
+        state = 0;
+        GLuint vs = compileShader(GL_VERTEX_SHADER, VERTEX_SHADER);
+        GLuint fs = compileShader(GL_FRAGMENT_SHADER, FRAGMENT_SHADER);
+        if(vs && fs)
+        {
+            program = glCreateProgram();
+            glAttachShader(program, vs);
+            glAttachShader(program, fs);
+            glBindAttribLocation(program, POSITION_ATTRIB, "instancePosition");
+            glBindAttribLocation(program, SCALE_ATTRIB, "instanceScale");
+            glBindAttribLocation(program, ROTATION_ATTRIB, "instanceRotation");
+            glBindAttribLocation(program, COLOR_ATTRIB, "instanceColor");
+            glLinkProgram(program);
+
+            GLint status = 0;
+            glGetProgramiv(program, GL_LINK_STATUS, &status);
+            if(status)
+            {
+                state = 1;
+            }
+            else
+            {
+                std::cout << "[InstanceBatch] program link failed" << std::endl;
+                glDeleteProgram(program);
+                program = 0;
+            }
+        }
+        if(vs)
+            glDeleteShader(vs);             // freed with the program
+        if(fs)
+            glDeleteShader(fs);
+        return program;
+    }
+#endif
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor
+///////////////////////////////////////////////////////////////////////////////
+InstanceBatch::InstanceBatch() : count(0), drawCallCount(0)
+{
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// check GLSL (GL 2.0), instanced arrays and buffer objects of the current
+// context
+// Without a current context glGetString() returns NULL, so it is not cached.
+///////////////////////////////////////////////////////////////////////////////
+bool InstanceBatch::isInstancingAvailable()
+{
+#ifdef INSTANCING_SUPPORTED
+    static int supported = -1;              // unknown
+    if(!instancingEnabled || !MeshBuffers::isAvailable())
+        return false;
+
+    if(supported < 0)
+    {
+        const char* version = (const char*)glGetString(GL_VERSION);
+        const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+        int major = 0, minor = 0;
+        if(!version || sscanf(version, "%d.%d", &major, &minor) != 2)
+            return false;
+        supported = (major >= 2 &&
+                     hasExtension(extensions, "GL_ARB_draw_instanced") &&
+                     hasExtension(extensions, "GL_ARB_instanced_arrays") &&
+                     getProgram() != 0) ? 1 : 0;
+    }
+    return supported == 1;
+#else
+    return false;
+#endif
+}
+
+void InstanceBatch::setInstancingEnabled(bool enabled)
+{
+    instancingEnabled = enabled;
+}
+
+bool InstanceBatch::getInstancingEnabled()
+{
+    return instancingEnabled;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// start over, the storage and the uploaded buffer are kept
+///////////////////////////////////////////////////////////////////////////////
+void InstanceBatch::clear()
+{
+    count = 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// append an instance, only mark it for upload if it differs from the one at
+// the same position last time
+///////////////////////////////////////////////////////////////////////////////
+void InstanceBatch::add(const vec3& position, const quat& rotation, const vec3& scale, const float color[4])
+{
+    Instance instance;
+    position.store(instance.position);
+    scale.store(instance.scale);
+    instance.rotation[0] = rotation.x;
+    instance.rotation[1] = rotation.y;
+    instance.rotation[2] = rotation.z;
+    instance.rotation[3] = rotation.w;
+    for(int i = 0; i < 4; ++i)
+    {
+        float c = color[i] < 0 ? 0 : (color[i] > 1 ? 1 : color[i]);
+        instance.color[i] = (unsigned char)(c * 255 + 0.5f);
+    }
+
+    if(count < instances.size())
+    {
+        if(memcmp(&instances[count], &instance, sizeof(Instance)) != 0)
+        {
+            instances[count] = instance;
+            buffers.invalidateVertices(count * sizeof(Instance), sizeof(Instance));
+        }
+    }
+    else
+    {
+        instances.push_back(instance);      // new size, uploaded all
+    }
+    ++count;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// draw all instances
+///////////////////////////////////////////////////////////////////////////////
+void InstanceBatch::draw(const Icosphere& mesh) const
+{
+    drawMesh(mesh);
+}
+
+void InstanceBatch::draw(const Cylinder& mesh) const
+{
+    drawMesh(mesh);
+}
+
+template<class Mesh>
+void InstanceBatch::drawMesh(const Mesh& mesh) const
+{
+    drawCallCount = 0;
+    if(count == 0)
+        return;
+
+    if(!drawInstanced(mesh))
+        drawBatched(mesh);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// one instanced draw call, return false if not possible
+// Compact vertices are decoded with the modelview matrix before the instance
+// transform would apply, so only the float format is instanced.
+///////////////////////////////////////////////////////////////////////////////
+template<class Mesh>
+bool InstanceBatch::drawInstanced(const Mesh& mesh) const
+{
+#ifdef INSTANCING_SUPPORTED
+    if(mesh.getVertexFormat() != VERTEX_FLOAT || !isInstancingAvailable())
+        return false;
+    if(!buffers.bindVertices(instances.data(), count * sizeof(Instance)))
+        return false;
+
+    // per-instance attributes from the instance buffer
+    const GLsizei stride = sizeof(Instance);
+    const char* base = 0;                   // offsets in the buffer
+    glVertexAttribPointer(POSITION_ATTRIB, 3, GL_FLOAT, GL_FALSE, stride, base + offsetof(Instance, position));
+    glVertexAttribPointer(SCALE_ATTRIB, 3, GL_FLOAT, GL_FALSE, stride, base + offsetof(Instance, scale));
+    glVertexAttribPointer(ROTATION_ATTRIB, 4, GL_FLOAT, GL_FALSE, stride, base + offsetof(Instance, rotation));
+    glVertexAttribPointer(COLOR_ATTRIB, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, base + offsetof(Instance, color));
+    const GLuint attribs[4] = { POSITION_ATTRIB, SCALE_ATTRIB, ROTATION_ATTRIB, COLOR_ATTRIB };
+    for(int i = 0; i < 4; ++i)
+    {
+        glEnableVertexAttribArray(attribs[i]);
+        glVertexAttribDivisorARB(attribs[i], 1);
+    }
+
+    glUseProgram(getProgram());
+    bool buffered = mesh.beginDraw();       // binds the mesh buffer
+    glDrawElementsInstancedARB(GL_TRIANGLES, mesh.getIndexCount(), mesh.getIndexType(),
+                               buffered ? 0 : mesh.getIndexData(), (GLsizei)count);
+    mesh.endDraw(buffered);
+    glUseProgram(0);
+
+    for(int i = 0; i < 4; ++i)
+    {
+        glVertexAttribDivisorARB(attribs[i], 0);
+        glDisableVertexAttribArray(attribs[i]);
+    }
+    drawCallCount = 1;
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// set up the mesh arrays once, then a matrix, a color and a draw per instance
+// The scale may be non-uniform, so GL_NORMALIZE is enabled.
+///////////////////////////////////////////////////////////////////////////////
+template<class Mesh>
+void InstanceBatch::drawBatched(const Mesh& mesh) const
+{
+    bool buffered = mesh.beginDraw();
+    glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+    glEnable(GL_NORMALIZE);
+
+    GLsizei indexCount = mesh.getIndexCount();
+    GLenum indexType = mesh.getIndexType();
+    const void* indices = buffered ? 0 : mesh.getIndexData();
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        const Instance& instance = instances[i];
+        const float* r = instance.rotation;
+        mat4 matrix = mat4::compose(vec3(instance.position), quat(r[0], r[1], r[2], r[3]), vec3(instance.scale));
+
+        glPushMatrix();
+        glMultMatrixf(matrix.data());
+        glColor4ubv(instance.color);
+        glDrawElements(GL_TRIANGLES, indexCount, indexType, indices);
+        glPopMatrix();
+    }
+    drawCallCount = (unsigned int)count;
+
+    glPopAttrib();
+    mesh.endDraw(buffered);
+}
@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////////
+// InstanceBatch.h
+// ===============
+// copies of one unit mesh drawn together, each with its own position,
+// rotation, scale and color
+// With GLSL and instanced arrays (GL_ARB_draw_instanced and
+// GL_ARB_instanced_arrays), the per-instance data is a buffer object read by
+// a vertex shader that does the fixed-function lighting of GL_LIGHT0, and
+// the whole batch is one glDrawElementsInstancedARB() call. Otherwise the
+// mesh arrays are set up once and each copy is a glMultMatrixf() and a
+// glDrawElements().
+// Fill the batch every frame with clear() then add(). Instances equal to the
+// ones added at the same position last frame are not uploaded again.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef GEOMETRY_INSTANCE_BATCH_H
+#define GEOMETRY_INSTANCE_BATCH_H
+
+#include <vector>
+#include <cstddef>
+#include "Math3d.h"
+#include "MeshBuffers.h"
+
+class Icosphere;
+class Cylinder;
+
+class InstanceBatch
+{
+public:
+    InstanceBatch();
+
+    // instanced drawing in the current GL context, and not disabled
+    static bool isInstancingAvailable();
+    static void setInstancingEnabled(bool enabled);     // false = batched draws
+    static bool getInstancingEnabled();
+
+    // the unit mesh is scaled, rotated and then moved to position
+    void clear();                           // keep storage for the next frame
+    void add(const vec3& position, const quat& rotation, const vec3& scale, const float color[4]);
+    int getInstanceCount() const            { return (int)count; }
+
+    // draw all instances of the mesh, triangles only
+    void draw(const Icosphere& mesh) const;
+    void draw(const Cylinder& mesh) const;
+
+    unsigned int getDrawCallCount() const   { return drawCallCount; }  // of the last draw
+    unsigned int getUploadCount() const     { return buffers.getUploadCount(); }
+    void releaseBuffers()                   { buffers.release(); }    // GL context must be current
+
+private:
+    // per-instance attributes, 44 bytes without padding
+    struct Instance
+    {
+        float position[3];
+        float scale[3];
+        float rotation[4];                  // quaternion x, y, z, w
+        unsigned char color[4];
+    };
+
+    template<class Mesh> void drawMesh(const Mesh& mesh) const;
+    template<class Mesh> bool drawInstanced(const Mesh& mesh) const;
+    template<class Mesh> void drawBatched(const Mesh& mesh) const;
+
+    std::vector<Instance> instances;        // may be longer than count
+    std::size_t count;                      // # of instances added since clear()
+    MeshBuffers buffers;                    // vertex buffer holds the instances
+    mutable unsigned int drawCallCount;
+};
+
+#endif
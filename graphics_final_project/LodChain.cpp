@@ -0,0 +1,138 @@
+///////////////////////////////////////////////////////////////////////////////
+// LodChain.cpp
+// ============
+// screen-space level of detail selection
+///////////////////////////////////////////////////////////////////////////////
+
+#define GL_SILENCE_DEPRECATION // silence deprecation warnings
+
+#ifdef _WIN32
+#include <windows.h>    // include windows.h to avoid thousands of compile errors even though this class is not depending on Windows
+#endif
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+#include <cfloat>
+#include "LodChain.h"
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor
+///////////////////////////////////////////////////////////////////////////////
+LodChain::LodChain(float hysteresis) : hysteresis(hysteresis), trianglesDrawn(0), trianglesFull(0),
+                                         finestDrawn(-1)
+{
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// append a coarser level, minPixels should decrease along the chain
+///////////////////////////////////////////////////////////////////////////////
+void LodChain::addLevel(float minPixels, unsigned int triangleCount)
+{
+    Level level = { minPixels, triangleCount };
+    levels.push_back(level);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// move from the current level one boundary at a time
+// Going finer needs the radius above the boundary by the hysteresis ratio,
+// going coarser needs it below by the same ratio.
+///////////////////////////////////////////////////////////////////////////////
+int LodChain::select(float pixels, int level) const
+{
+    int count = (int)levels.size();
+    if(count == 0)
+        return -1;
+
+    // a new instance takes the level of the radius as is
+    if(level < 0 || level >= count)
+    {
+        for(level = 0; level < count - 1; ++level)
+        {
+            if(pixels >= levels[level].minPixels)
+                break;
+        }
+        return level;
+    }
+
+    while(level > 0 && pixels >= levels[level - 1].minPixels * (1 + hysteresis))
+        --level;
+    while(level < count - 1 && pixels < levels[level].minPixels * (1 - hysteresis))
+        ++level;
+    return level;
+}
+
+int LodChain::getBiased(int level, int bias) const
+{
+    level += bias;
+    if(level >= (int)levels.size())
+        level = (int)levels.size() - 1;
+    if(level < 0)
+        level = 0;
+    return level;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// triangle counts of a frame
+///////////////////////////////////////////////////////////////////////////////
+void LodChain::resetStats()
+{
+    trianglesDrawn = trianglesFull = 0;
+    finestDrawn = -1;
+}
+
+void LodChain::addDrawn(int level)
+{
+    if(level < 0 || level >= (int)levels.size())
+        return;
+
+    trianglesDrawn += levels[level].triangleCount;
+    trianglesFull += levels[0].triangleCount;
+    if(finestDrawn < 0 || level < finestDrawn)
+        finestDrawn = level;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// project the radius at the center, the origin of the modelview matrix by
+// default
+// The clip w of the center is its distance along the view direction, and
+// the projection scales Y by P[5], so a radius covers
+// radius * P[5] / w * (viewport height / 2) pixels. Return FLT_MAX if the
+// center is not in front of the eye, then the finest level is used.
+///////////////////////////////////////////////////////////////////////////////
+float LodChain::computeScreenRadius(float radius)
+{
+    mat4 modelview, projection;
+    GLint viewport[4];
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview.data());
+    glGetFloatv(GL_PROJECTION_MATRIX, projection.data());
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    return computeScreenRadius(radius, vec3(), modelview, projection, viewport[3]);
+}
+
+float LodChain::computeScreenRadius(float radius, const vec3& center, const mat4& modelview,
+                                    const mat4& projection, int viewportHeight)
+{
+    // clip w of the center in eye space
+    const mat4& p = projection;
+    vec3 eye = transformPoint(modelview, center);
+    float w = p[3] * eye.x + p[7] * eye.y + p[11] * eye.z + p[15];
+    if(w <= 0)
+        return FLT_MAX;
+
+    return radius * p[5] / w * viewportHeight * 0.5f;
+}
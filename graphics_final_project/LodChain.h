@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////////
+// LodChain.h
+// ==========
+// screen-space level of detail selection
+// A chain has levels from the finest to the coarsest, and each level is used
+// while the projected radius of an instance is at least its minimum # of
+// pixels. An instance keeps its current level until the radius crosses the
+// boundary by the hysteresis ratio, so it does not pop back and forth when it
+// stays near a boundary. The chain also counts the triangles drawn per frame
+// and the triangles the finest level would have drawn.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef GEOMETRY_LOD_CHAIN_H
+#define GEOMETRY_LOD_CHAIN_H
+
+#include <vector>
+#include "Math3d.h"
+
+class LodChain
+{
+public:
+    LodChain(float hysteresis=0.15f);
+
+    // add the next coarser level, used while the radius >= minPixels
+    void addLevel(float minPixels, unsigned int triangleCount);
+    int getLevelCount() const               { return (int)levels.size(); }
+    float getHysteresis() const             { return hysteresis; }
+    void setHysteresis(float ratio)         { hysteresis = ratio; }
+
+    // return the level for the projected radius, starting from the current
+    // level of the instance (-1 for a new instance)
+    int select(float pixels, int level) const;
+
+    // level to draw with a detail bias (# of levels coarser), clamped
+    int getBiased(int level, int bias) const;
+
+    // per-frame triangle counts
+    void resetStats();
+    void addDrawn(int level);
+    unsigned int getTrianglesDrawn() const  { return trianglesDrawn; }
+    unsigned int getTrianglesFull() const   { return trianglesFull; }   // all at the finest level
+    unsigned int getTrianglesSaved() const  { return trianglesFull - trianglesDrawn; }
+    int getFinestDrawn() const              { return finestDrawn; }     // -1 if none
+
+    // projected radius in pixels of a sphere at the origin of the current
+    // modelview matrix, with the current projection and viewport
+    static float computeScreenRadius(float radius);
+
+    // same for a sphere at center in model space, with the matrices and the
+    // viewport height read once per frame instead of per instance
+    static float computeScreenRadius(float radius, const vec3& center, const mat4& modelview,
+                                     const mat4& projection, int viewportHeight);
+
+private:
+    struct Level
+    {
+        float minPixels;
+        unsigned int triangleCount;
+    };
+    std::vector<Level> levels;              // finest first
+    float hysteresis;
+    unsigned int trianglesDrawn;
+    unsigned int trianglesFull;
+    int finestDrawn;
+};
+
+#endif
@@ -0,0 +1,246 @@
+///////////////////////////////////////////////////////////////////////////////
+// Math3d.h
+// ========
+// small vector math for geometry builders and transforms
+// vec3, vec4, mat4 and quat are plain structs of floats, so they are
+// trivially copyable and passed/returned by value without any heap
+// allocation. Everything is constexpr except what needs sqrt/sin/cos.
+// vec3 is 12 bytes to match xyz in vertex arrays (load with vec3(ptr),
+// write with store(ptr)); vec4, mat4 and quat are 16-byte aligned for SIMD
+// loads. mat4 is column-major like OpenGL, so data() goes to glMultMatrixf().
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef GEOMETRY_MATH3D_H
+#define GEOMETRY_MATH3D_H
+
+#include <cmath>
+#include <type_traits>
+
+///////////////////////////////////////////////////////////////////////////////
+// 3D vector
+///////////////////////////////////////////////////////////////////////////////
+struct vec3
+{
+    float x, y, z;
+
+    constexpr vec3() : x(0), y(0), z(0) {}
+    constexpr vec3(float x, float y, float z) : x(x), y(y), z(z) {}
+    constexpr explicit vec3(const float* v) : x(v[0]), y(v[1]), z(v[2]) {}
+
+    const float* data() const               { return &x; }
+    float* data()                           { return &x; }
+    void store(float* v) const              { v[0] = x; v[1] = y; v[2] = z; }
+    float length() const                    { return sqrtf(x*x + y*y + z*z); }
+
+    vec3& operator+=(const vec3& v)         { x += v.x; y += v.y; z += v.z; return *this; }
+    vec3& operator-=(const vec3& v)         { x -= v.x; y -= v.y; z -= v.z; return *this; }
+    vec3& operator*=(float s)               { x *= s; y *= s; z *= s; return *this; }
+};
+
+constexpr vec3 operator+(const vec3& a, const vec3& b)  { return vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+constexpr vec3 operator-(const vec3& a, const vec3& b)  { return vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+constexpr vec3 operator-(const vec3& v)                 { return vec3(-v.x, -v.y, -v.z); }
+constexpr vec3 operator*(const vec3& v, float s)        { return vec3(v.x * s, v.y * s, v.z * s); }
+constexpr vec3 operator*(float s, const vec3& v)        { return vec3(v.x * s, v.y * s, v.z * s); }
+constexpr bool operator==(const vec3& a, const vec3& b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+constexpr bool operator!=(const vec3& a, const vec3& b) { return !(a == b); }
+
+constexpr float dot(const vec3& a, const vec3& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+constexpr vec3 cross(const vec3& a, const vec3& b)
+{
+    return vec3(a.y * b.z - a.z * b.y,
+                a.z * b.x - a.x * b.z,
+                a.x * b.y - a.y * b.x);
+}
+
+// unit vector, or (0,0,0) if the length is not greater than epsilon
+inline vec3 normalize(const vec3& v, float epsilon=0)
+{
+    float length = v.length();
+    if(length > epsilon)
+        return v * (1.0f / length);
+    return vec3();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// 4D vector
+///////////////////////////////////////////////////////////////////////////////
+struct alignas(16) vec4
+{
+    float x, y, z, w;
+
+    constexpr vec4() : x(0), y(0), z(0), w(0) {}
+    constexpr vec4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+    constexpr vec4(const vec3& v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+
+    constexpr vec3 xyz() const              { return vec3(x, y, z); }
+    const float* data() const               { return &x; }
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// quaternion (x, y, z, w), w is the scalar part
+///////////////////////////////////////////////////////////////////////////////
+struct alignas(16) quat
+{
+    float x, y, z, w;
+
+    constexpr quat() : x(0), y(0), z(0), w(1) {}        // identity
+    constexpr quat(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+
+    // rotation by angle (radian) around a unit axis
+    static quat fromAxisAngle(const vec3& axis, float angle)
+    {
+        float s = sinf(angle * 0.5f);
+        return quat(axis.x * s, axis.y * s, axis.z * s, cosf(angle * 0.5f));
+    }
+
+    // shortest rotation from unit vector a to unit vector b
+    static quat fromTo(const vec3& a, const vec3& b)
+    {
+        float d = dot(a, b);
+        if(d < -0.999999f)
+        {
+            // opposite, turn 180 degrees around any axis perpendicular to a
+            vec3 axis = cross(vec3(1, 0, 0), a);
+            if(dot(axis, axis) < 0.000001f)
+                axis = cross(vec3(0, 1, 0), a);
+            axis = normalize(axis);
+            return quat(axis.x, axis.y, axis.z, 0);
+        }
+        // half-way quaternion (a x b, 1 + a.b), then normalized
+        vec3 c = cross(a, b);
+        float w = 1 + d;
+        float invLength = 1.0f / sqrtf(dot(c, c) + w * w);
+        return quat(c.x * invLength, c.y * invLength, c.z * invLength, w * invLength);
+    }
+
+    constexpr vec3 axis() const             { return vec3(x, y, z); }
+};
+
+constexpr quat operator*(const quat& a, const quat& b)
+{
+    return quat(a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+                a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+                a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+                a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z);
+}
+
+// rotate v by unit quaternion q: v + 2w(u x v) + 2u x (u x v)
+constexpr vec3 rotate(const quat& q, const vec3& v)
+{
+    return v + cross(q.axis(), cross(q.axis(), v) + v * q.w) * 2.0f;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// 4x4 matrix, column-major
+// m[0..3] is the 1st column, m[12..14] is the translation
+///////////////////////////////////////////////////////////////////////////////
+struct alignas(16) mat4
+{
+    float m[16];
+
+    const float* data() const               { return m; }
+    float* data()                           { return m; }
+    float operator[](int index) const       { return m[index]; }
+    float& operator[](int index)            { return m[index]; }
+
+    static constexpr mat4 identity()
+    {
+        return mat4{ { 1, 0, 0, 0,
+                       0, 1, 0, 0,
+                       0, 0, 1, 0,
+                       0, 0, 0, 1 } };
+    }
+
+    // columns of 3 axes and translation
+    static constexpr mat4 fromColumns(const vec3& x, const vec3& y, const vec3& z, const vec3& t)
+    {
+        return mat4{ { x.x, x.y, x.z, 0,
+                       y.x, y.y, y.z, 0,
+                       z.x, z.y, z.z, 0,
+                       t.x, t.y, t.z, 1 } };
+    }
+
+    static constexpr mat4 translation(const vec3& t)
+    {
+        return fromColumns(vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1), t);
+    }
+
+    static constexpr mat4 scale(const vec3& s)
+    {
+        return fromColumns(vec3(s.x, 0, 0), vec3(0, s.y, 0), vec3(0, 0, s.z), vec3());
+    }
+
+    static constexpr mat4 rotation(const quat& q)
+    {
+        return compose(vec3(), q, vec3(1, 1, 1));
+    }
+
+    // translate * rotate * scale, built directly without multiplications
+    static constexpr mat4 compose(const vec3& t, const quat& q, const vec3& s)
+    {
+        return fromColumns(vec3(1 - 2 * (q.y * q.y + q.z * q.z), 2 * (q.x * q.y + q.z * q.w), 2 * (q.x * q.z - q.y * q.w)) * s.x,
+                           vec3(2 * (q.x * q.y - q.z * q.w), 1 - 2 * (q.x * q.x + q.z * q.z), 2 * (q.y * q.z + q.x * q.w)) * s.y,
+                           vec3(2 * (q.x * q.z + q.y * q.w), 2 * (q.y * q.z - q.x * q.w), 1 - 2 * (q.x * q.x + q.y * q.y)) * s.z,
+                           t);
+    }
+
+    constexpr vec3 getColumn(int index) const   { return vec3(m[index * 4], m[index * 4 + 1], m[index * 4 + 2]); }
+};
+
+constexpr mat4 operator*(const mat4& a, const mat4& b)
+{
+    mat4 r = {};
+    for(int c = 0; c < 4; ++c)
+    {
+        for(int i = 0; i < 4; ++i)
+        {
+            r.m[c * 4 + i] = a.m[i]      * b.m[c * 4]     + a.m[4 + i]  * b.m[c * 4 + 1] +
+                             a.m[8 + i]  * b.m[c * 4 + 2] + a.m[12 + i] * b.m[c * 4 + 3];
+        }
+    }
+    return r;
+}
+
+// transform a point (w = 1), the result is not divided by w
+constexpr vec3 transformPoint(const mat4& a, const vec3& v)
+{
+    return vec3(a.m[0] * v.x + a.m[4] * v.y + a.m[8]  * v.z + a.m[12],
+                a.m[1] * v.x + a.m[5] * v.y + a.m[9]  * v.z + a.m[13],
+                a.m[2] * v.x + a.m[6] * v.y + a.m[10] * v.z + a.m[14]);
+}
+
+// transform a direction (w = 0)
+constexpr vec3 transformVector(const mat4& a, const vec3& v)
+{
+    return vec3(a.m[0] * v.x + a.m[4] * v.y + a.m[8]  * v.z,
+                a.m[1] * v.x + a.m[5] * v.y + a.m[9]  * v.z,
+                a.m[2] * v.x + a.m[6] * v.y + a.m[10] * v.z);
+}
+
+constexpr vec4 operator*(const mat4& a, const vec4& v)
+{
+    return vec4(a.m[0] * v.x + a.m[4] * v.y + a.m[8]  * v.z + a.m[12] * v.w,
+                a.m[1] * v.x + a.m[5] * v.y + a.m[9]  * v.z + a.m[13] * v.w,
+                a.m[2] * v.x + a.m[6] * v.y + a.m[10] * v.z + a.m[14] * v.w,
+                a.m[3] * v.x + a.m[7] * v.y + a.m[11] * v.z + a.m[15] * v.w);
+}
+
+// layout the builders and OpenGL rely on
+static_assert(sizeof(vec3) == 3 * sizeof(float), "vec3 must be packed xyz");
+static_assert(sizeof(mat4) == 16 * sizeof(float), "mat4 must be 16 floats");
+static_assert(std::is_trivially_copyable<vec3>::value && std::is_trivially_copyable<vec4>::value &&
+              std::is_trivially_copyable<quat>::value && std::is_trivially_copyable<mat4>::value,
+              "math types must be trivially copyable");
+
+#endif
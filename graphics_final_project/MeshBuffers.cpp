@@ -0,0 +1,287 @@
+///////////////////////////////////////////////////////////////////////////////
+// MeshBuffers.cpp
+// ===============
+// GPU buffer objects of a mesh: interleaved vertices, triangle indices and
+// line indices
+///////////////////////////////////////////////////////////////////////////////
+
+#define GL_SILENCE_DEPRECATION // silence deprecation warnings
+
+#ifdef _WIN32
+#include <windows.h>    // include windows.h to avoid thousands of compile errors even though this class is not depending on Windows
+#endif
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#define GL_GLEXT_PROTOTYPES     // buffer functions are GL 1.5, not in gl.h
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+#include <cstdio>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include "MeshBuffers.h"
+
+// opengl32.dll exports GL 1.1 only and there is no function loader in this
+// project, so Windows draws from client arrays
+#ifndef _WIN32
+#define MESH_BUFFERS_SUPPORTED
+#endif
+
+namespace
+{
+    bool buffersEnabled = true;
+
+    // buffer names of destroyed objects, deleted on the next bind
+    // They are never destroyed, so objects destroyed at exit can still use
+    // them after other statics are gone.
+    std::vector<unsigned int>& getOrphanBuffers()
+    {
+        static std::vector<unsigned int>* buffers = new std::vector<unsigned int>();
+        return *buffers;
+    }
+
+    std::mutex& getOrphanMutex()
+    {
+        static std::mutex* mutex = new std::mutex();
+        return *mutex;
+    }
+
+    std::atomic<bool> hasOrphanBuffers(false);  // read without the lock on each bind
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctors/dtor
+///////////////////////////////////////////////////////////////////////////////
+MeshBuffers::MeshBuffers() : uploadCount(0)
+{
+    resetBuffer(vertexBuffer);
+    resetBuffer(indexBuffer);
+    resetBuffer(lineIndexBuffer);
+}
+
+MeshBuffers::MeshBuffers(const MeshBuffers&) : uploadCount(0)
+{
+    resetBuffer(vertexBuffer);
+    resetBuffer(indexBuffer);
+    resetBuffer(lineIndexBuffer);
+}
+
+MeshBuffers& MeshBuffers::operator=(const MeshBuffers& rhs)
+{
+    // keep own GL buffers, the new data is uploaded on next bind
+    if(this != &rhs)
+        invalidate();
+    return *this;
+}
+
+MeshBuffers::~MeshBuffers()
+{
+    // no context may be current here, leave the names to the next bind
+    unsigned int ids[3] = { vertexBuffer.id, indexBuffer.id, lineIndexBuffer.id };
+    if(!ids[0] && !ids[1] && !ids[2])
+        return;
+
+    std::lock_guard<std::mutex> lock(getOrphanMutex());
+    for(int i = 0; i < 3; ++i)
+    {
+        if(ids[i])
+            getOrphanBuffers().push_back(ids[i]);
+    }
+    hasOrphanBuffers = true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// check GL version of the current context, buffer objects are core in 1.5
+// Without a current context glGetString() returns NULL, so it is not cached.
+///////////////////////////////////////////////////////////////////////////////
+bool MeshBuffers::isAvailable()
+{
+#ifdef MESH_BUFFERS_SUPPORTED
+    static int supported = -1;              // unknown
+    if(!buffersEnabled)
+        return false;
+
+    if(supported < 0)
+    {
+        const char* version = (const char*)glGetString(GL_VERSION);
+        int major = 0, minor = 0;
+        if(!version || sscanf(version, "%d.%d", &major, &minor) != 2)
+            return false;
+        supported = (major > 1 || (major == 1 && minor >= 5)) ? 1 : 0;
+    }
+    return supported == 1;
+#else
+    return false;
+#endif
+}
+
+void MeshBuffers::setEnabled(bool enabled)
+{
+    buffersEnabled = enabled;
+}
+
+bool MeshBuffers::getEnabled()
+{
+    return buffersEnabled;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// mark data as changed
+///////////////////////////////////////////////////////////////////////////////
+void MeshBuffers::invalidate()
+{
+    vertexBuffer.dirty = indexBuffer.dirty = lineIndexBuffer.dirty = true;
+}
+
+void MeshBuffers::invalidateVertices(std::size_t offset, std::size_t size)
+{
+    if(vertexBuffer.dirty || size == 0)
+        return;
+
+    // grow the pending span to cover both
+    if(vertexBuffer.dirtyBegin == vertexBuffer.dirtyEnd)
+    {
+        vertexBuffer.dirtyBegin = offset;
+        vertexBuffer.dirtyEnd = offset + size;
+    }
+    else
+    {
+        if(offset < vertexBuffer.dirtyBegin)
+            vertexBuffer.dirtyBegin = offset;
+        if(offset + size > vertexBuffer.dirtyEnd)
+            vertexBuffer.dirtyEnd = offset + size;
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// upload and bind
+///////////////////////////////////////////////////////////////////////////////
+bool MeshBuffers::bindVertices(const void* data, std::size_t size) const
+{
+#ifdef MESH_BUFFERS_SUPPORTED
+    return bindBuffer(vertexBuffer, GL_ARRAY_BUFFER, data, size);
+#else
+    return false;
+#endif
+}
+
+bool MeshBuffers::bindIndices(const void* data, std::size_t size) const
+{
+#ifdef MESH_BUFFERS_SUPPORTED
+    return bindBuffer(indexBuffer, GL_ELEMENT_ARRAY_BUFFER, data, size);
+#else
+    return false;
+#endif
+}
+
+bool MeshBuffers::bindLineIndices(const void* data, std::size_t size) const
+{
+#ifdef MESH_BUFFERS_SUPPORTED
+    return bindBuffer(lineIndexBuffer, GL_ELEMENT_ARRAY_BUFFER, data, size);
+#else
+    return false;
+#endif
+}
+
+void MeshBuffers::unbind()
+{
+#ifdef MESH_BUFFERS_SUPPORTED
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+#endif
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// create the buffer on first use, upload all if dirty or resized, otherwise
+// the pending span only
+///////////////////////////////////////////////////////////////////////////////
+bool MeshBuffers::bindBuffer(Buffer& buffer, unsigned int target, const void* data, std::size_t size) const
+{
+#ifdef MESH_BUFFERS_SUPPORTED
+    if(!isAvailable())
+        return false;
+
+    if(hasOrphanBuffers)
+        deleteOrphanBuffers();
+
+    if(buffer.id == 0)
+    {
+        glGenBuffers(1, &buffer.id);
+        buffer.dirty = true;
+    }
+    glBindBuffer(target, buffer.id);
+
+    if(buffer.dirty || buffer.size != size)
+    {
+        glBufferData(target, size, data, GL_STATIC_DRAW);
+        buffer.size = size;
+        ++uploadCount;
+    }
+    else if(buffer.dirtyBegin < buffer.dirtyEnd && buffer.dirtyEnd <= size)
+    {
+        glBufferSubData(target, buffer.dirtyBegin, buffer.dirtyEnd - buffer.dirtyBegin,
+                        (const char*)data + buffer.dirtyBegin);
+        ++uploadCount;
+    }
+    buffer.dirty = false;
+    buffer.dirtyBegin = buffer.dirtyEnd = 0;
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// delete GL buffers, the data is uploaded again on next bind
+///////////////////////////////////////////////////////////////////////////////
+void MeshBuffers::release()
+{
+#ifdef MESH_BUFFERS_SUPPORTED
+    unsigned int ids[3] = { vertexBuffer.id, indexBuffer.id, lineIndexBuffer.id };
+    for(int i = 0; i < 3; ++i)
+    {
+        if(ids[i])
+            glDeleteBuffers(1, &ids[i]);
+    }
+#endif
+    resetBuffer(vertexBuffer);
+    resetBuffer(indexBuffer);
+    resetBuffer(lineIndexBuffer);
+}
+
+// delete the buffers queued by destructors, a context must be current
+void MeshBuffers::deleteOrphanBuffers()
+{
+#ifdef MESH_BUFFERS_SUPPORTED
+    std::lock_guard<std::mutex> lock(getOrphanMutex());
+    std::vector<unsigned int>& buffers = getOrphanBuffers();
+    if(!buffers.empty())
+        glDeleteBuffers((GLsizei)buffers.size(), &buffers[0]);
+    buffers.clear();
+    hasOrphanBuffers = false;
+#endif
+}
+
+void MeshBuffers::resetBuffer(Buffer& buffer)
+{
+    buffer.id = 0;
+    buffer.size = 0;
+    buffer.dirty = true;
+    buffer.dirtyBegin = buffer.dirtyEnd = 0;
+}
@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////////
+// MeshBuffers.h
+// =============
+// GPU buffer objects of a mesh: interleaved vertices, triangle indices and
+// line indices
+// Meshes are often built before a GL context exists, so nothing is uploaded
+// at build time. invalidate() marks the data as changed, and the next bind
+// uploads it. Vertices moved in place are re-uploaded only for the changed
+// byte span with glBufferSubData(), and indices are kept as they are.
+// bind returns false if buffer objects are unavailable (GL < 1.5, no loader
+// on Windows, or disabled), and the mesh draws from client arrays instead.
+// The destructor makes no GL call, since objects may outlive the context
+// (globals at exit). It queues the buffer names, and the next bind of any
+// object deletes them, with a context current. Buffers still queued at exit
+// are freed with the context. release() deletes them now.
+// A copy has no buffers of its own until its first bind.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef GEOMETRY_MESH_BUFFERS_H
+#define GEOMETRY_MESH_BUFFERS_H
+
+#include <cstddef>
+
+class MeshBuffers
+{
+public:
+    MeshBuffers();
+    MeshBuffers(const MeshBuffers& rhs);
+    MeshBuffers& operator=(const MeshBuffers& rhs);
+    ~MeshBuffers();
+
+    // buffer objects in the current GL context, and not disabled
+    static bool isAvailable();
+    static void setEnabled(bool enabled);   // false = client arrays for all meshes
+    static bool getEnabled();
+
+    // data changed, upload on next bind
+    void invalidate();                      // vertices and indices
+    void invalidateVertices(std::size_t offset, std::size_t size);  // byte span of vertices
+
+    // upload if changed, then bind, return false if not available
+    bool bindVertices(const void* data, std::size_t size) const;
+    bool bindIndices(const void* data, std::size_t size) const;
+    bool bindLineIndices(const void* data, std::size_t size) const;
+    static void unbind();                   // bind 0 to both targets
+
+    void release();                         // delete GL buffers now
+    unsigned int getUploadCount() const     { return uploadCount; }    // # of uploads
+
+private:
+    struct Buffer
+    {
+        unsigned int id;                    // GL buffer name, 0 if not created
+        std::size_t size;                   // # of bytes uploaded
+        bool dirty;                         // upload all on next bind
+        std::size_t dirtyBegin;             // byte span to upload if not dirty
+        std::size_t dirtyEnd;
+    };
+
+    static void resetBuffer(Buffer& buffer);
+    static void deleteOrphanBuffers();
+    bool bindBuffer(Buffer& buffer, unsigned int target, const void* data, std::size_t size) const;
+
+    mutable Buffer vertexBuffer;
+    mutable Buffer indexBuffer;
+    mutable Buffer lineIndexBuffer;
+    mutable unsigned int uploadCount;
+};
+
+#endif
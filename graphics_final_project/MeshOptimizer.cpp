@@ -0,0 +1,452 @@
+///////////////////////////////////////////////////////////////////////////////
+// MeshOptimizer.cpp
+// =================
+// post-build optimization of indexed triangle meshes
+// Vertex cache optimization follows "Linear-Speed Vertex Cache Optimisation"
+// by Tom Forsyth: each vertex is scored by its position in a simulated LRU
+// cache and by the # of triangles still using it, and the next triangle is
+// the one with the highest sum among the triangles touching the cache.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include <algorithm>
+#include "MeshOptimizer.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+const int CACHE_SIZE               = 32;    // LRU cache model of optimizer
+const float CACHE_DECAY_POWER      = 1.5f;
+const float LAST_TRIANGLE_SCORE    = 0.75f; // vertices of last triangle
+const float VALENCE_BOOST_SCALE    = 2.0f;  // prefer vertices with few triangles left
+const float VALENCE_BOOST_POWER    = 0.5f;
+const int MAX_VALENCE_SCORE        = 64;    // size of valence score table
+const unsigned int UNUSED          = ~0u;
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// score tables, built once so scoring is a lookup
+///////////////////////////////////////////////////////////////////////////////
+namespace
+{
+    struct VertexScoreTables
+    {
+        float cacheScores[CACHE_SIZE];
+        float valenceScores[MAX_VALENCE_SCORE];
+
+        VertexScoreTables()
+        {
+            for(int i = 0; i < CACHE_SIZE; ++i)
+            {
+                if(i < 3)
+                    cacheScores[i] = LAST_TRIANGLE_SCORE;
+                else
+                    cacheScores[i] = powf(1.0f - (i - 3) / (float)(CACHE_SIZE - 3), CACHE_DECAY_POWER);
+            }
+            valenceScores[0] = 0;
+            for(int i = 1; i < MAX_VALENCE_SCORE; ++i)
+                valenceScores[i] = VALENCE_BOOST_SCALE * powf((float)i, -VALENCE_BOOST_POWER);
+        }
+    };
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// score of a vertex at cache position (-1 if not in cache) with the # of
+// triangles not emitted yet
+///////////////////////////////////////////////////////////////////////////////
+static float computeVertexScore(int cachePosition, unsigned int activeCount)
+{
+    // initialized once even if meshes are optimized on several threads
+    static const VertexScoreTables tables;
+    const float* cacheScores = tables.cacheScores;
+    const float* valenceScores = tables.valenceScores;
+
+    if(activeCount == 0)
+        return -1.0f;       // no triangle needs it anymore
+
+    float score = cachePosition >= 0 ? cacheScores[cachePosition] : 0.0f;
+    if(activeCount < (unsigned int)MAX_VALENCE_SCORE)
+        score += valenceScores[activeCount];
+    else
+        score += VALENCE_BOOST_SCALE * powf((float)activeCount, -VALENCE_BOOST_POWER);
+    return score;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// reorder triangles for post-transform vertex cache
+///////////////////////////////////////////////////////////////////////////////
+void MeshOptimizer::optimizeVertexCache(unsigned int* indices, std::size_t indexCount, std::size_t vertexCount)
+{
+    std::size_t triangleCount = indexCount / 3;
+    if(triangleCount < 2)
+        return;
+
+    // build vertex-triangle adjacency; the first activeCounts[v] entries of
+    // each list are the triangles of v which are not emitted yet
+    std::vector<unsigned int> activeCounts(vertexCount, 0);
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    std::vector<unsigned int> adjacency(triangleCount * 3);
+    std::size_t i, j, k;
+    for(i = 0; i < triangleCount * 3; ++i)
+        ++activeCounts[indices[i]];
+    for(i = 0; i < vertexCount; ++i)
+        offsets[i + 1] = offsets[i] + activeCounts[i];
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for(i = 0; i < triangleCount * 3; ++i)
+        adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+    // initial scores
+    std::vector<int> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for(i = 0; i < vertexCount; ++i)
+        vertexScores[i] = computeVertexScore(-1, activeCounts[i]);
+
+    std::vector<float> triangleScores(triangleCount);
+    for(i = 0; i < triangleCount; ++i)
+    {
+        triangleScores[i] = vertexScores[indices[i * 3]] +
+                            vertexScores[indices[i * 3 + 1]] +
+                            vertexScores[indices[i * 3 + 2]];
+    }
+
+    std::vector<unsigned char> emitted(triangleCount, 0);
+    std::vector<unsigned int> output(triangleCount * 3);
+    unsigned int cache[CACHE_SIZE + 3];
+    unsigned int newCache[CACHE_SIZE + 3];
+    int cacheCount = 0;
+    std::size_t scanCursor = 0;     // for the case no triangle touches the cache
+    long long best = 0;
+
+    for(std::size_t out = 0; out < triangleCount; ++out)
+    {
+        if(best < 0)
+        {
+            while(emitted[scanCursor])
+                ++scanCursor;
+            best = (long long)scanCursor;
+        }
+
+        const unsigned int* tri = &indices[best * 3];
+        output[out * 3]     = tri[0];
+        output[out * 3 + 1] = tri[1];
+        output[out * 3 + 2] = tri[2];
+        emitted[best] = 1;
+
+        // remove the triangle from the active lists of its vertices
+        for(j = 0; j < 3; ++j)
+        {
+            unsigned int v = tri[j];
+            unsigned int* list = &adjacency[offsets[v]];
+            unsigned int last = --activeCounts[v];
+            for(k = 0; k < last; ++k)
+            {
+                if(list[k] == (unsigned int)best)
+                {
+                    list[k] = list[last];
+                    list[last] = (unsigned int)best;
+                    break;
+                }
+            }
+        }
+
+        // move the vertices of the triangle to the front of LRU cache
+        int newCount = 0;
+        newCache[newCount++] = tri[0];
+        newCache[newCount++] = tri[1];
+        newCache[newCount++] = tri[2];
+        for(int c = 0; c < cacheCount; ++c)
+        {
+            unsigned int v = cache[c];
+            if(v != tri[0] && v != tri[1] && v != tri[2])
+                newCache[newCount++] = v;
+        }
+
+        // update scores of vertices in cache and the ones pushed out of it,
+        // then propagate the difference to their active triangles
+        for(int c = 0; c < newCount; ++c)
+        {
+            unsigned int v = newCache[c];
+            int position = c < CACHE_SIZE ? c : -1;
+            cachePositions[v] = position;
+            float score = computeVertexScore(position, activeCounts[v]);
+            float diff = score - vertexScores[v];
+            vertexScores[v] = score;
+            const unsigned int* list = &adjacency[offsets[v]];
+            for(k = 0; k < activeCounts[v]; ++k)
+                triangleScores[list[k]] += diff;
+        }
+
+        // next triangle is the best one using a vertex in cache
+        best = -1;
+        float bestScore = -1.0f;
+        cacheCount = newCount < CACHE_SIZE ? newCount : CACHE_SIZE;
+        for(int c = 0; c < cacheCount; ++c)
+        {
+            unsigned int v = newCache[c];
+            cache[c] = v;
+            const unsigned int* list = &adjacency[offsets[v]];
+            for(k = 0; k < activeCounts[v]; ++k)
+            {
+                if(triangleScores[list[k]] > bestScore)
+                {
+                    bestScore = triangleScores[list[k]];
+                    best = list[k];
+                }
+            }
+        }
+    }
+
+    for(i = 0; i < triangleCount * 3; ++i)
+        indices[i] = output[i];
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// renumber vertices in the order of first use
+///////////////////////////////////////////////////////////////////////////////
+std::vector<unsigned int> MeshOptimizer::optimizeVertexFetch(unsigned int* indices, std::size_t indexCount,
+                                                             std::size_t vertexCount)
+{
+    std::vector<unsigned int> remap(vertexCount, UNUSED);
+    unsigned int next = 0;
+    std::size_t i;
+    for(i = 0; i < indexCount; ++i)
+    {
+        unsigned int& newIndex = remap[indices[i]];
+        if(newIndex == UNUSED)
+            newIndex = next++;
+        indices[i] = newIndex;
+    }
+
+    // keep unreferenced vertices at the end
+    for(i = 0; i < vertexCount; ++i)
+    {
+        if(remap[i] == UNUSED)
+            remap[i] = next++;
+    }
+    return remap;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// compare position, then texcoord of 2 vertices
+///////////////////////////////////////////////////////////////////////////////
+static int compareVertex(const float* vertices, const float* texCoords, unsigned int a, unsigned int b)
+{
+    const float* va = &vertices[a * 3];
+    const float* vb = &vertices[b * 3];
+    for(int i = 0; i < 3; ++i)
+    {
+        if(va[i] != vb[i])
+            return va[i] < vb[i] ? -1 : 1;
+    }
+    const float* ta = &texCoords[a * 2];
+    const float* tb = &texCoords[b * 2];
+    for(int i = 0; i < 2; ++i)
+    {
+        if(ta[i] != tb[i])
+            return ta[i] < tb[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// weld flat-shaded vertices, store face normals on provoking vertices
+///////////////////////////////////////////////////////////////////////////////
+std::vector<unsigned int> MeshOptimizer::weldFlatVertices(std::vector<float>& vertices, std::vector<float>& normals,
+                                                          std::vector<float>& texCoords, std::vector<unsigned int>& indices)
+{
+    std::size_t vertexCount = vertices.size() / 3;
+    std::size_t triangleCount = indices.size() / 3;
+    std::size_t i, j;
+
+    // face normal is the normal of any corner
+    std::vector<float> faceNormals(triangleCount * 3);
+    for(i = 0; i < triangleCount; ++i)
+    {
+        const float* n = &normals[indices[i * 3] * 3];
+        faceNormals[i * 3]     = n[0];
+        faceNormals[i * 3 + 1] = n[1];
+        faceNormals[i * 3 + 2] = n[2];
+    }
+
+    // group equal vertices by sorting, the first vertex of a group represents it
+    std::vector<unsigned int> sorted(vertexCount);
+    for(i = 0; i < vertexCount; ++i)
+        sorted[i] = (unsigned int)i;
+    const float* v = vertices.data();
+    const float* t = texCoords.data();
+    std::sort(sorted.begin(), sorted.end(), [v, t](unsigned int a, unsigned int b)
+    {
+        int result = compareVertex(v, t, a, b);
+        return result < 0 || (result == 0 && a < b);
+    });
+    std::vector<unsigned int> representatives(vertexCount);
+    for(i = 0; i < vertexCount; ++i)
+    {
+        if(i > 0 && compareVertex(v, t, sorted[i - 1], sorted[i]) == 0)
+            representatives[sorted[i]] = representatives[sorted[i - 1]];
+        else
+            representatives[sorted[i]] = sorted[i];
+    }
+
+    // number the groups in the original order, so the vertex order is kept
+    std::vector<unsigned int> remap(vertexCount);
+    std::vector<float> newVertices, newTexCoords;
+    newVertices.reserve(vertices.size());
+    newTexCoords.reserve(texCoords.size());
+    unsigned int weldedCount = 0;
+    for(i = 0; i < vertexCount; ++i)
+    {
+        if(representatives[i] == i)
+        {
+            remap[i] = weldedCount++;
+            newVertices.insert(newVertices.end(), &vertices[i * 3], &vertices[i * 3] + 3);
+            newTexCoords.insert(newTexCoords.end(), &texCoords[i * 2], &texCoords[i * 2] + 2);
+        }
+        else
+        {
+            remap[i] = remap[representatives[i]];
+        }
+    }
+    remapIndices(indices, remap);
+
+    // choose the provoking vertex of each triangle among the corners not
+    // claimed yet, preferring the one with the fewest triangles left, so the
+    // shared vertices remain available for the later triangles
+    std::vector<unsigned int> remainingCounts(weldedCount, 0);
+    for(i = 0; i < triangleCount * 3; ++i)
+        ++remainingCounts[indices[i]];
+    std::vector<unsigned char> claimed(weldedCount, 0);
+    std::vector<float> newNormals(weldedCount * 3, 0.0f);
+    for(i = 0; i < triangleCount; ++i)
+    {
+        unsigned int* tri = &indices[i * 3];
+        int corner = -1;
+        for(j = 0; j < 3; ++j)
+        {
+            --remainingCounts[tri[j]];
+            if(!claimed[tri[j]] && (corner < 0 || remainingCounts[tri[j]] < remainingCounts[tri[corner]]))
+                corner = (int)j;
+        }
+
+        if(corner < 0)
+        {
+            // duplicate the last corner
+            unsigned int src = tri[2];
+            float vertex[3] = { newVertices[src * 3], newVertices[src * 3 + 1], newVertices[src * 3 + 2] };
+            float texCoord[2] = { newTexCoords[src * 2], newTexCoords[src * 2 + 1] };
+            newVertices.insert(newVertices.end(), vertex, vertex + 3);
+            newTexCoords.insert(newTexCoords.end(), texCoord, texCoord + 2);
+            newNormals.insert(newNormals.end(), 3, 0.0f);
+            claimed.push_back(0);
+            tri[2] = weldedCount++;
+            corner = 2;
+        }
+
+        // rotate the triangle (keep winding), so the provoking vertex is last
+        unsigned int provoking = tri[corner];
+        unsigned int i1 = tri[(corner + 1) % 3];
+        unsigned int i2 = tri[(corner + 2) % 3];
+        tri[0] = i1;
+        tri[1] = i2;
+        tri[2] = provoking;
+        claimed[provoking] = 1;
+        newNormals[provoking * 3]     = faceNormals[i * 3];
+        newNormals[provoking * 3 + 1] = faceNormals[i * 3 + 1];
+        newNormals[provoking * 3 + 2] = faceNormals[i * 3 + 2];
+    }
+
+    // vertices never used as provoking vertex get the normal of a triangle
+    // using them, it only matters if drawn without GL_FLAT
+    for(i = 0; i < triangleCount * 3; ++i)
+    {
+        unsigned int index = indices[i];
+        if(!claimed[index])
+        {
+            const float* n = &faceNormals[(i / 3) * 3];
+            newNormals[index * 3]     = n[0];
+            newNormals[index * 3 + 1] = n[1];
+            newNormals[index * 3 + 2] = n[2];
+            claimed[index] = 1;
+        }
+    }
+
+    vertices.swap(newVertices);
+    normals.swap(newNormals);
+    texCoords.swap(newTexCoords);
+    return remap;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// apply remap table
+///////////////////////////////////////////////////////////////////////////////
+void MeshOptimizer::remapIndices(std::vector<unsigned int>& indices, const std::vector<unsigned int>& remap)
+{
+    for(std::size_t i = 0, count = indices.size(); i < count; ++i)
+        indices[i] = remap[indices[i]];
+}
+
+void MeshOptimizer::remapAttribs(std::vector<float>& attribs, int components, const std::vector<unsigned int>& remap)
+{
+    std::vector<float> tmp(attribs.size());
+    std::size_t count = attribs.size() / components;
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        const float* src = &attribs[i * components];
+        float* dst = &tmp[remap[i] * components];
+        for(int j = 0; j < components; ++j)
+            dst[j] = src[j];
+    }
+    attribs.swap(tmp);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// simulate FIFO cache, a vertex is in cache if it missed within the last
+// cacheSize misses
+///////////////////////////////////////////////////////////////////////////////
+VertexCacheStats MeshOptimizer::analyzeVertexCache(const unsigned int* indices, std::size_t indexCount,
+                                                   std::size_t vertexCount, int cacheSize)
+{
+    VertexCacheStats stats = { 0, 0 };
+    std::size_t triangleCount = indexCount / 3;
+    if(triangleCount == 0)
+        return stats;
+
+    std::vector<unsigned int> timestamps(vertexCount, 0);
+    std::vector<unsigned char> used(vertexCount, 0);
+    unsigned int timestamp = (unsigned int)cacheSize + 1;
+    unsigned int misses = 0;
+    unsigned int uniqueCount = 0;
+    for(std::size_t i = 0; i < triangleCount * 3; ++i)
+    {
+        unsigned int v = indices[i];
+        if(timestamp - timestamps[v] > (unsigned int)cacheSize)
+        {
+            timestamps[v] = timestamp++;
+            ++misses;
+        }
+        if(!used[v])
+        {
+            used[v] = 1;
+            ++uniqueCount;
+        }
+    }
+
+    stats.acmr = (float)misses / triangleCount;
+    stats.atvr = (float)misses / uniqueCount;
+    return stats;
+}
@@ -0,0 +1,57 @@
+///////////////////////////////////////////////////////////////////////////////
+// MeshOptimizer.h
+// ===============
+// post-build optimization of indexed triangle meshes
+// optimizeVertexCache() reorders triangles for the post-transform vertex cache
+// with Tom Forsyth's linear-speed algorithm (LRU cache model, 32 entries).
+// optimizeVertexFetch() renumbers vertices in the order of first use, so the
+// vertex fetches walk through memory sequentially; apply the returned remap
+// table to every attribute array and to the other index arrays.
+// weldFlatVertices() shares the vertices of a flat-shaded mesh and keeps each
+// face normal once, on the provoking (last) vertex of its triangle.
+// analyzeVertexCache() simulates a FIFO cache and reports
+// ACMR (cache misses per triangle) and ATVR (cache misses per vertex).
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef GEOMETRY_MESH_OPTIMIZER_H
+#define GEOMETRY_MESH_OPTIMIZER_H
+
+#include <vector>
+#include <cstddef>
+
+// result of vertex cache simulation
+struct VertexCacheStats
+{
+    float acmr;                             // average cache miss ratio, 0.5 ~ 3.0
+    float atvr;                             // average transformed vertex ratio, 1.0 is optimal
+};
+
+class MeshOptimizer
+{
+public:
+    // reorder triangles of indices[0, indexCount) in place
+    static void optimizeVertexCache(unsigned int* indices, std::size_t indexCount, std::size_t vertexCount);
+
+    // renumber vertices in the order of first use in indices, then return
+    // remap table (old index -> new index); unused vertices go to the end
+    static std::vector<unsigned int> optimizeVertexFetch(unsigned int* indices, std::size_t indexCount,
+                                                         std::size_t vertexCount);
+
+    // weld vertices with same position and texcoord of flat-shaded triangles
+    // (all 3 normals are the face normal), then move each face normal to a
+    // vertex used as the last corner of that triangle only; a vertex is
+    // duplicated if all corners already carry another face normal. Return
+    // remap table (old index -> welded index) for other index arrays.
+    static std::vector<unsigned int> weldFlatVertices(std::vector<float>& vertices, std::vector<float>& normals,
+                                                      std::vector<float>& texCoords, std::vector<unsigned int>& indices);
+
+    // apply remap table to indices or attributes with given # of components
+    static void remapIndices(std::vector<unsigned int>& indices, const std::vector<unsigned int>& remap);
+    static void remapAttribs(std::vector<float>& attribs, int components, const std::vector<unsigned int>& remap);
+
+    // simulate FIFO cache of given size
+    static VertexCacheStats analyzeVertexCache(const unsigned int* indices, std::size_t indexCount,
+                                               std::size_t vertexCount, int cacheSize=16);
+};
+
+#endif
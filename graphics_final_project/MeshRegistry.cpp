@@ -0,0 +1,402 @@
+///////////////////////////////////////////////////////////////////////////////
+// MeshRegistry.cpp
+// ================
+// process-wide registry of unit meshes (flyweights)
+///////////////////////////////////////////////////////////////////////////////
+
+#define GL_SILENCE_DEPRECATION // silence deprecation warnings
+
+#ifdef _WIN32
+#include <windows.h>    // include windows.h to avoid thousands of compile errors even though this class is not depending on Windows
+#endif
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include "MeshRegistry.h"
+
+
+
+// registry storage ///////////////////////////////////////////////////////////
+namespace
+{
+    typedef std::pair<int, bool> IcosphereKey;                             // subdivision, smooth
+    typedef std::tuple<int, int, float, float, bool, bool> CylinderKey;    // sectors, stacks, unit base/top radius, smooth, strut
+
+    std::mutex& getMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    // weak refs, so a mesh is freed when no instance uses it
+    std::map<IcosphereKey, std::weak_ptr<const Icosphere> >& getIcospheres()
+    {
+        static std::map<IcosphereKey, std::weak_ptr<const Icosphere> > icospheres;
+        return icospheres;
+    }
+
+    std::map<CylinderKey, std::weak_ptr<const Cylinder> >& getCylinders()
+    {
+        static std::map<CylinderKey, std::weak_ptr<const Cylinder> > cylinders;
+        return cylinders;
+    }
+
+    // count alive meshes and drop expired entries
+    template<class Map>
+    unsigned int countAlive(Map& meshes)
+    {
+        unsigned int count = 0;
+        for(typename Map::iterator it = meshes.begin(); it != meshes.end();)
+        {
+            if(it->second.expired())
+            {
+                it = meshes.erase(it);
+            }
+            else
+            {
+                ++count;
+                ++it;
+            }
+        }
+        return count;
+    }
+
+    // larger radius of a cylinder, it is the XY scale of the unit mesh
+    float getMaxRadius(float baseRadius, float topRadius)
+    {
+        float radius = (baseRadius > topRadius) ? baseRadius : topRadius;
+        return (radius > 0) ? radius : 1.0f;
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// return the shared unit icosphere, build it if it does not exist
+///////////////////////////////////////////////////////////////////////////////
+IcosphereHandle MeshRegistry::getIcosphere(int subdivision, bool smooth)
+{
+    std::lock_guard<std::mutex> lock(getMutex());
+
+    std::weak_ptr<const Icosphere>& entry = getIcospheres()[IcosphereKey(subdivision, smooth)];
+    IcosphereHandle mesh = entry.lock();
+    if(!mesh)
+    {
+        std::shared_ptr<Icosphere> sphere = std::make_shared<Icosphere>(1.0f, subdivision, smooth, false);
+        sphere->setWelded(true);            // share vertices if flat shading
+        sphere->setSingleStorage(true);     // draw-only, interleaved array is enough
+        sphere->commit();                   // build before sharing, not lazily by a reader
+        mesh = sphere;
+        entry = mesh;
+    }
+    return mesh;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// return the shared unit cylinder, build it if it does not exist
+// The unit mesh has height 1 and the larger radius 1, so the key only depends
+// on the taper ratio of the radii.
+///////////////////////////////////////////////////////////////////////////////
+CylinderHandle MeshRegistry::getCylinder(int sectors, int stacks, float baseRadius, float topRadius, bool smooth,
+                                         bool strut)
+{
+    float maxRadius = getMaxRadius(baseRadius, topRadius);
+    float unitBase = baseRadius / maxRadius;
+    float unitTop = topRadius / maxRadius;
+
+    std::lock_guard<std::mutex> lock(getMutex());
+
+    std::weak_ptr<const Cylinder>& entry = getCylinders()[CylinderKey(sectors, strut ? 1 : stacks, unitBase, unitTop, smooth, strut)];
+    CylinderHandle mesh = entry.lock();
+    if(!mesh)
+    {
+        std::shared_ptr<Cylinder> cylinder = std::make_shared<Cylinder>(unitBase, unitTop, 1.0f, sectors, stacks, smooth, false);
+        cylinder->setWelded(true);          // share vertices if flat shading
+        cylinder->setStrut(strut);
+        cylinder->setSingleStorage(true);   // draw-only, interleaved array is enough
+        cylinder->commit();                 // build before sharing, not lazily by a reader
+        mesh = cylinder;
+        entry = mesh;
+    }
+    return mesh;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// # of unit meshes alive
+///////////////////////////////////////////////////////////////////////////////
+unsigned int MeshRegistry::getIcosphereCount()
+{
+    std::lock_guard<std::mutex> lock(getMutex());
+    return countAlive(getIcospheres());
+}
+
+unsigned int MeshRegistry::getCylinderCount()
+{
+    std::lock_guard<std::mutex> lock(getMutex());
+    return countAlive(getCylinders());
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IcosphereInstance
+///////////////////////////////////////////////////////////////////////////////
+IcosphereInstance::IcosphereInstance(float radius, int subdivision, bool smooth)
+    : radius(radius), subdivision(subdivision), smooth(smooth), dirty(true), rebuildCount(0)
+{
+    commit();
+}
+
+void IcosphereInstance::setSubdivision(int subdivision)
+{
+    if(this->subdivision == subdivision)
+        return;
+
+    this->subdivision = subdivision;
+    dirty = true;       // look up on next access
+}
+
+void IcosphereInstance::setSmooth(bool smooth)
+{
+    if(this->smooth == smooth)
+        return;
+
+    this->smooth = smooth;
+    dirty = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// look up the shared mesh if any parameter has changed
+///////////////////////////////////////////////////////////////////////////////
+void IcosphereInstance::commit()
+{
+    if(!dirty)
+        return;
+
+    dirty = false;
+    ++rebuildCount;
+    mesh = MeshRegistry::getIcosphere(subdivision, smooth);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// scale the unit mesh to the radius
+// normals must be re-normalized after scaling
+///////////////////////////////////////////////////////////////////////////////
+void IcosphereInstance::beginScale() const
+{
+    glPushAttrib(GL_ENABLE_BIT);
+    glEnable(GL_RESCALE_NORMAL);    // uniform scale only
+    glPushMatrix();
+    glScalef(radius, radius, radius);
+}
+
+void IcosphereInstance::endScale() const
+{
+    glPopMatrix();
+    glPopAttrib();
+}
+
+void IcosphereInstance::draw() const
+{
+    update();
+    beginScale();
+    mesh->draw();
+    endScale();
+}
+
+void IcosphereInstance::drawLines(const float lineColor[4]) const
+{
+    update();
+    beginScale();
+    mesh->drawLines(lineColor);
+    endScale();
+}
+
+void IcosphereInstance::drawWithLines(const float lineColor[4]) const
+{
+    update();
+    beginScale();
+    mesh->drawWithLines(lineColor);
+    endScale();
+}
+
+void IcosphereInstance::printSelf() const
+{
+    update();
+    std::cout << "===== Icosphere Instance =====\n"
+              << "        Radius: " << radius << "\n"
+              << "   Shared Mesh: " << mesh.use_count() - 1 << " other instance(s)\n";
+    mesh->printSelf();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CylinderInstance
+///////////////////////////////////////////////////////////////////////////////
+CylinderInstance::CylinderInstance(float baseRadius, float topRadius, float height, int sectors,
+                                   int stacks, bool smooth) : strut(false), rebuildCount(0)
+{
+    set(baseRadius, topRadius, height, sectors, stacks, smooth);
+    commit();
+}
+
+void CylinderInstance::set(float baseRadius, float topRadius, float height, int sectors,
+                           int stacks, bool smooth)
+{
+    this->baseRadius = baseRadius;
+    this->topRadius = topRadius;
+    this->height = height;
+    this->sectorCount = sectors;
+    this->stackCount = stacks;
+    this->smooth = smooth;
+    dirty = true;       // look up on next access
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// look up the shared mesh if any parameter has changed
+///////////////////////////////////////////////////////////////////////////////
+void CylinderInstance::commit()
+{
+    if(!dirty)
+        return;
+
+    dirty = false;
+    ++rebuildCount;
+    mesh = MeshRegistry::getCylinder(sectorCount, stackCount, baseRadius, topRadius, smooth, strut);
+
+    // clamp sectors/stacks same as the shared mesh, strut mode does not
+    // overwrite the stacks to use without it
+    this->sectorCount = mesh->getSectorCount();
+    if(!strut)
+        this->stackCount = mesh->getStackCount();
+}
+
+void CylinderInstance::setBaseRadius(float radius)
+{
+    if(this->baseRadius != radius)
+        set(radius, topRadius, height, sectorCount, stackCount, smooth);
+}
+
+void CylinderInstance::setTopRadius(float radius)
+{
+    if(this->topRadius != radius)
+        set(baseRadius, radius, height, sectorCount, stackCount, smooth);
+}
+
+void CylinderInstance::setSectorCount(int sectors)
+{
+    if(this->sectorCount != sectors)
+        set(baseRadius, topRadius, height, sectors, stackCount, smooth);
+}
+
+void CylinderInstance::setStackCount(int stacks)
+{
+    if(this->stackCount != stacks)
+        set(baseRadius, topRadius, height, sectorCount, stacks, smooth);
+}
+
+void CylinderInstance::setSmooth(bool smooth)
+{
+    if(this->smooth != smooth)
+        set(baseRadius, topRadius, height, sectorCount, stackCount, smooth);
+}
+
+void CylinderInstance::setStrut(bool strut)
+{
+    if(this->strut == strut)
+        return;
+
+    this->strut = strut;
+    dirty = true;       // look up on next access
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// scale the unit mesh to the radius and height
+// non-uniform scale requires full normalization of normals
+///////////////////////////////////////////////////////////////////////////////
+void CylinderInstance::beginScale() const
+{
+    float radius = getMaxRadius(baseRadius, topRadius);
+    glPushAttrib(GL_ENABLE_BIT);
+    glEnable(GL_NORMALIZE);
+    glPushMatrix();
+    glScalef(radius, radius, height);
+}
+
+void CylinderInstance::endScale() const
+{
+    glPopMatrix();
+    glPopAttrib();
+}
+
+void CylinderInstance::draw() const
+{
+    update();
+    beginScale();
+    mesh->draw();
+    endScale();
+}
+
+void CylinderInstance::drawBase() const
+{
+    update();
+    beginScale();
+    mesh->drawBase();
+    endScale();
+}
+
+void CylinderInstance::drawTop() const
+{
+    update();
+    beginScale();
+    mesh->drawTop();
+    endScale();
+}
+
+void CylinderInstance::drawSide() const
+{
+    update();
+    beginScale();
+    mesh->drawSide();
+    endScale();
+}
+
+void CylinderInstance::drawLines(const float lineColor[4]) const
+{
+    update();
+    beginScale();
+    mesh->drawLines(lineColor);
+    endScale();
+}
+
+void CylinderInstance::drawWithLines(const float lineColor[4]) const
+{
+    update();
+    beginScale();
+    mesh->drawWithLines(lineColor);
+    endScale();
+}
+
+void CylinderInstance::printSelf() const
+{
+    update();
+    std::cout << "===== Cylinder Instance =====\n"
+              << "   Base Radius: " << baseRadius << "\n"
+              << "    Top Radius: " << topRadius << "\n"
+              << "        Height: " << height << "\n"
+              << "   Shared Mesh: " << mesh.use_count() - 1 << " other instance(s)\n";
+    mesh->printSelf();
+}
@@ -0,0 +1,150 @@
+///////////////////////////////////////////////////////////////////////////////
+// MeshRegistry.h
+// ==============
+// process-wide registry of unit meshes (flyweights)
+// Each unit Icosphere is built once per (subdivision, smooth) and each unit
+// Cylinder once per (sectors, stacks, taper ratio, smooth), then shared by
+// ref-counted immutable handles. A mesh is released when the last handle is
+// gone. The radius/height of an instance is applied as a scale transform.
+// Flat-shaded unit meshes are welded (see Icosphere::setWelded()). Strut
+// cylinders have 1 stack and no caps (see Cylinder::setStrut()).
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef GEOMETRY_MESH_REGISTRY_H
+#define GEOMETRY_MESH_REGISTRY_H
+
+#include <memory>
+#include "Icosphere.h"
+#include "Cylinder.h"
+
+typedef std::shared_ptr<const Icosphere> IcosphereHandle;
+typedef std::shared_ptr<const Cylinder> CylinderHandle;
+
+class MeshRegistry
+{
+public:
+    // unit icosphere (radius=1)
+    static IcosphereHandle getIcosphere(int subdivision, bool smooth);
+
+    // unit cylinder (height=1, larger radius=1), taper = smaller / larger radius
+    static CylinderHandle getCylinder(int sectors, int stacks, float baseRadius, float topRadius, bool smooth,
+                                      bool strut=false);
+
+    // # of unit meshes alive
+    static unsigned int getIcosphereCount();
+    static unsigned int getCylinderCount();
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// icosphere sharing a unit mesh, scaled by radius
+///////////////////////////////////////////////////////////////////////////////
+class IcosphereInstance
+{
+public:
+    IcosphereInstance(float radius=1.0f, int subdivision=1, bool smooth=false);
+
+    float getRadius() const                 { return radius; }
+    void setRadius(float radius)            { this->radius = radius; }
+    int getSubdivision() const              { return subdivision; }
+    void setSubdivision(int subdivision);
+    bool getSmooth() const                  { return smooth; }
+    void setSmooth(bool smooth);
+    const IcosphereHandle& getMesh() const  { update(); return mesh; }
+
+    // setters only record parameters, the shared mesh is looked up once on
+    // the first access or draw; commit() does it now
+    void commit();
+    unsigned int getRebuildCount() const    { return rebuildCount; }   // # of mesh lookups
+
+    unsigned int getVertexCount() const     { return getMesh()->getVertexCount(); }
+    unsigned int getIndexCount() const      { return getMesh()->getIndexCount(); }
+    unsigned int getTriangleCount() const   { return getMesh()->getTriangleCount(); }
+
+    // draw unit mesh with scale transform
+    void draw() const;
+    void drawLines(const float lineColor[4]) const;
+    void drawWithLines(const float lineColor[4]) const;
+
+    void printSelf() const;
+
+private:
+    void beginScale() const;
+    void endScale() const;
+    void update() const                     { if(dirty) const_cast<IcosphereInstance*>(this)->commit(); }
+
+    float radius;
+    int subdivision;
+    bool smooth;
+    IcosphereHandle mesh;
+    bool dirty;                             // parameters changed since last lookup
+    unsigned int rebuildCount;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// cylinder sharing a unit mesh, scaled by radius (XY) and height (Z)
+///////////////////////////////////////////////////////////////////////////////
+class CylinderInstance
+{
+public:
+    CylinderInstance(float baseRadius=1.0f, float topRadius=1.0f, float height=1.0f,
+                     int sectorCount=36, int stackCount=1, bool smooth=true);
+
+    float getBaseRadius() const             { return baseRadius; }
+    float getTopRadius() const              { return topRadius; }
+    float getHeight() const                 { return height; }
+    int getSectorCount() const              { update(); return sectorCount; }  // clamped by mesh
+    int getStackCount() const               { return getMesh()->getStackCount(); }    // 1 in strut mode
+    bool getSmooth() const                  { return smooth; }
+    void set(float baseRadius, float topRadius, float height,
+             int sectorCount, int stackCount, bool smooth=true);
+    void setBaseRadius(float radius);
+    void setTopRadius(float radius);
+    void setHeight(float height)            { this->height = height; }  // scale only
+    void setSectorCount(int sectorCount);
+    void setStackCount(int stackCount);
+    void setSmooth(bool smooth);
+    bool getStrut() const                   { return strut; }
+    void setStrut(bool strut);              // 1 stack, no caps
+    const CylinderHandle& getMesh() const   { update(); return mesh; }
+
+    // setters only record parameters, the shared mesh is looked up once on
+    // the first access or draw; commit() does it now
+    void commit();
+    unsigned int getRebuildCount() const    { return rebuildCount; }   // # of mesh lookups
+
+    unsigned int getVertexCount() const     { return getMesh()->getVertexCount(); }
+    unsigned int getIndexCount() const      { return getMesh()->getIndexCount(); }
+    unsigned int getTriangleCount() const   { return getMesh()->getTriangleCount(); }
+
+    // draw unit mesh with scale transform
+    void draw() const;
+    void drawBase() const;
+    void drawTop() const;
+    void drawSide() const;
+    void drawLines(const float lineColor[4]) const;
+    void drawWithLines(const float lineColor[4]) const;
+
+    void printSelf() const;
+
+private:
+    void beginScale() const;
+    void endScale() const;
+    void update() const                     { if(dirty) const_cast<CylinderInstance*>(this)->commit(); }
+
+    float baseRadius;
+    float topRadius;
+    float height;
+    int sectorCount;
+    int stackCount;                         // as set, kept in strut mode
+    bool smooth;
+    bool strut;
+    CylinderHandle mesh;
+    bool dirty;                             // parameters changed since last lookup
+    unsigned int rebuildCount;
+};
+
+#endif
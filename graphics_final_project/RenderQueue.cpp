@@ -0,0 +1,242 @@
+///////////////////////////////////////////////////////////////////////////////
+// RenderQueue.cpp
+// ===============
+// draw items collected during a frame, sorted by state and mesh, then
+// submitted with each state and each mesh set up once
+///////////////////////////////////////////////////////////////////////////////
+
+#define GL_SILENCE_DEPRECATION // silence deprecation warnings
+
+#ifdef _WIN32
+#include <windows.h>    // include windows.h to avoid thousands of compile errors even though this class is not depending on Windows
+#endif
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+#include <algorithm>
+#include <functional>
+#include "RenderQueue.h"
+#include "Icosphere.h"
+#include "Cylinder.h"
+
+// constants //////////////////////////////////////////////////////////////////
+const float OFFSET_FACTOR = 1.0f;       // polygon offset of surfaces under lines
+const float OFFSET_UNITS  = 1.0f;
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor
+///////////////////////////////////////////////////////////////////////////////
+RenderQueue::RenderQueue()
+{
+    stats.itemCount = stats.drawCallCount = stats.meshSetupCount = stats.stateChangeCount = 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// drop the items, the storage is kept for the next frame
+///////////////////////////////////////////////////////////////////////////////
+void RenderQueue::clear()
+{
+    items.clear();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// append an item, DRAW_FILL_WITH_LINES adds a surface and a line item
+///////////////////////////////////////////////////////////////////////////////
+void RenderQueue::add(const Icosphere& mesh, const vec3& position, const quat& rotation, const vec3& scale,
+                      const float color[4], DrawMode mode)
+{
+    addItem(MESH_ICOSPHERE, &mesh, position, rotation, scale, color, mode);
+}
+
+void RenderQueue::add(const Cylinder& mesh, const vec3& position, const quat& rotation, const vec3& scale,
+                      const float color[4], DrawMode mode)
+{
+    addItem(MESH_CYLINDER, &mesh, position, rotation, scale, color, mode);
+}
+
+void RenderQueue::addItem(int meshType, const void* mesh, const vec3& position, const quat& rotation,
+                          const vec3& scale, const float color[4], DrawMode mode)
+{
+    Item item;
+    item.meshType = meshType;
+    item.mesh = mesh;
+    item.position = position;
+    item.rotation = rotation;
+    item.scale = scale;
+    for(int i = 0; i < 4; ++i)
+        item.color[i] = color[i];
+
+    if(mode == DRAW_FILL)
+    {
+        item.pass = PASS_FILL;
+        items.push_back(item);
+        return;
+    }
+    if(mode == DRAW_FILL_WITH_LINES)
+    {
+        item.pass = PASS_FILL_OFFSET;
+        items.push_back(item);
+    }
+    item.pass = PASS_LINES;
+    items.push_back(item);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// sort key: pass, then mesh
+///////////////////////////////////////////////////////////////////////////////
+bool RenderQueue::isBefore(const Item& a, const Item& b)
+{
+    if(a.pass != b.pass)
+        return a.pass < b.pass;
+    if(a.meshType != b.meshType)
+        return a.meshType < b.meshType;
+    return std::less<const void*>()(a.mesh, b.mesh);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// sort the items and draw each group of the same pass and mesh together
+// The sort is stable, so a group keeps the order of add() and the instance
+// batch of the group is not uploaded again if the items did not change.
+// The GL state of the passes is restored at the end.
+///////////////////////////////////////////////////////////////////////////////
+void RenderQueue::submit()
+{
+    stats.itemCount = (unsigned int)items.size();
+    stats.drawCallCount = stats.meshSetupCount = stats.stateChangeCount = 0;
+
+    std::stable_sort(items.begin(), items.end(), isBefore);
+
+    glPushAttrib(GL_ENABLE_BIT | GL_POLYGON_BIT | GL_CURRENT_BIT);
+    int pass = PASS_FILL;
+    for(std::size_t first = 0, last; first < items.size(); first = last)
+    {
+        const Item& item = items[first];
+        for(last = first + 1; last < items.size(); ++last)
+        {
+            if(items[last].pass != item.pass || items[last].mesh != item.mesh)
+                break;
+        }
+
+        setPass(item.pass, pass);
+        if(item.pass == PASS_LINES)
+        {
+            if(item.meshType == MESH_ICOSPHERE)
+                drawLines(*(const Icosphere*)item.mesh, &items[first], &items[0] + last);
+            else
+                drawLines(*(const Cylinder*)item.mesh, &items[first], &items[0] + last);
+            continue;
+        }
+
+        Batch& batch = batches[BatchKey(item.pass, item.mesh)];
+        batch.used = true;
+        drawFill(batch.instances, &items[first], &items[0] + last);
+    }
+    glPopAttrib();
+
+    // release buffers of meshes not drawn this frame
+    for(std::map<BatchKey, Batch>::iterator it = batches.begin(); it != batches.end();)
+    {
+        if(it->second.used)
+        {
+            it->second.used = false;
+            ++it;
+        }
+        else
+        {
+            batches.erase(it++);
+        }
+    }
+    items.clear();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// switch from the current pass to the next one, passes only go forward
+///////////////////////////////////////////////////////////////////////////////
+void RenderQueue::setPass(int pass, int& current)
+{
+    if(pass == current)
+        return;
+
+    if(current == PASS_FILL_OFFSET)
+    {
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        ++stats.stateChangeCount;
+    }
+    if(pass == PASS_FILL_OFFSET)
+    {
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(OFFSET_FACTOR, OFFSET_UNITS);
+        stats.stateChangeCount += 2;
+    }
+    else if(pass == PASS_LINES)
+    {
+        glDisable(GL_LIGHTING);
+        glDisable(GL_TEXTURE_2D);
+        stats.stateChangeCount += 2;
+    }
+    current = pass;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// draw the surfaces of a group with its instance batch
+///////////////////////////////////////////////////////////////////////////////
+void RenderQueue::drawFill(InstanceBatch& batch, const Item* first, const Item* last)
+{
+    batch.clear();
+    for(const Item* item = first; item != last; ++item)
+        batch.add(item->position, item->rotation, item->scale, item->color);
+
+    if(first->meshType == MESH_ICOSPHERE)
+        batch.draw(*(const Icosphere*)first->mesh);
+    else
+        batch.draw(*(const Cylinder*)first->mesh);
+
+    stats.drawCallCount += batch.getDrawCallCount();
+    ++stats.meshSetupCount;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// draw the lines of a group, the line arrays are set up once
+///////////////////////////////////////////////////////////////////////////////
+template<class Mesh>
+void RenderQueue::drawLines(const Mesh& mesh, const Item* first, const Item* last)
+{
+    bool buffered = mesh.beginDrawLines();
+    GLsizei indexCount = mesh.getLineIndexCount();
+    GLenum indexType = mesh.getIndexType();
+    const void* indices = buffered ? 0 : mesh.getLineIndexData();
+    for(const Item* item = first; item != last; ++item)
+    {
+        mat4 matrix = mat4::compose(item->position, item->rotation, item->scale);
+
+        glPushMatrix();
+        glMultMatrixf(matrix.data());
+        glColor4fv(item->color);
+        glDrawElements(GL_LINES, indexCount, indexType, indices);
+        glPopMatrix();
+    }
+    mesh.endDrawLines(buffered);
+
+    stats.drawCallCount += (unsigned int)(last - first);
+    ++stats.meshSetupCount;
+}
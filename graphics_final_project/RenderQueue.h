@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////////////////////////////////
+// RenderQueue.h
+// =============
+// draw items collected during a frame, sorted by state and mesh, then
+// submitted with each state and each mesh set up once
+// An item is a mesh with a position, rotation, scale, color and draw mode.
+// submit() sorts the items by pass (fill, fill under lines, lines) and then
+// by mesh, keeping the order in which they were added within a group:
+// - fill groups go through an InstanceBatch per mesh, so they are one
+//   instanced call each, or one array setup and a draw per item
+// - line groups set up the vertex array and line indices once per mesh, and
+//   lighting and texturing are turned off once for all of them
+// The meshes must stay alive until submit() returns.
+// getStats() counts the work of the last submit() to validate the savings.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef GEOMETRY_RENDER_QUEUE_H
+#define GEOMETRY_RENDER_QUEUE_H
+
+#include <vector>
+#include <map>
+#include <utility>
+#include "Math3d.h"
+#include "InstanceBatch.h"
+
+class Icosphere;
+class Cylinder;
+
+class RenderQueue
+{
+public:
+    enum DrawMode
+    {
+        DRAW_FILL = 0,
+        DRAW_LINES,                         // lines only, unlit
+        DRAW_FILL_WITH_LINES                // surface pushed back, lines on top
+    };
+
+    // per-frame counters
+    struct Stats
+    {
+        unsigned int itemCount;             // # of items submitted
+        unsigned int drawCallCount;         // glDrawElements*()
+        unsigned int meshSetupCount;        // client arrays, pointers and buffer binds of a mesh
+        unsigned int stateChangeCount;      // glEnable/glDisable/glPolygonOffset by the queue
+    };
+
+    RenderQueue();
+
+    void clear();                           // drop items of the last frame
+    void add(const Icosphere& mesh, const vec3& position, const quat& rotation, const vec3& scale,
+             const float color[4], DrawMode mode=DRAW_FILL);
+    void add(const Cylinder& mesh, const vec3& position, const quat& rotation, const vec3& scale,
+             const float color[4], DrawMode mode=DRAW_FILL);
+    int getItemCount() const                { return (int)items.size(); }
+
+    // sort and draw all items, then clear them
+    void submit();
+    const Stats& getStats() const           { return stats; }
+    void releaseBuffers()                   { batches.clear(); }      // GL context must be current
+
+private:
+    // passes in drawing order
+    enum Pass
+    {
+        PASS_FILL = 0,
+        PASS_FILL_OFFSET,                   // with polygon offset, under lines
+        PASS_LINES
+    };
+
+    enum MeshType
+    {
+        MESH_ICOSPHERE = 0,
+        MESH_CYLINDER
+    };
+
+    struct Item
+    {
+        int pass;
+        int meshType;
+        const void* mesh;
+        vec3 position;
+        vec3 scale;
+        quat rotation;
+        float color[4];
+    };
+
+    // instances of a fill group, kept across frames so that unchanged
+    // instances are not uploaded again
+    struct Batch
+    {
+        Batch() : used(false) {}
+        InstanceBatch instances;
+        bool used;                          // drawn this frame
+    };
+    typedef std::pair<int, const void*> BatchKey;   // pass, mesh
+
+    void addItem(int meshType, const void* mesh, const vec3& position, const quat& rotation, const vec3& scale,
+                 const float color[4], DrawMode mode);
+    static bool isBefore(const Item& a, const Item& b);
+    void setPass(int pass, int& current);
+    void drawFill(InstanceBatch& batch, const Item* first, const Item* last);
+    template<class Mesh> void drawLines(const Mesh& mesh, const Item* first, const Item* last);
+
+    std::vector<Item> items;
+    std::map<BatchKey, Batch> batches;
+    Stats stats;
+};
+
+#endif
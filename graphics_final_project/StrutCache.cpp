@@ -0,0 +1,75 @@
+///////////////////////////////////////////////////////////////////////////////
+// StrutCache.cpp
+// ==============
+// cached model matrices of struts between 2 points
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include "StrutCache.h"
+
+// constants //////////////////////////////////////////////////////////////////
+const float EPSILON = 0.000001f;
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ctor
+///////////////////////////////////////////////////////////////////////////////
+StrutCache::StrutCache(int count) : updateCount(0)
+{
+    resize(count);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// resize the cache, new struts are computed on their first set()
+///////////////////////////////////////////////////////////////////////////////
+void StrutCache::resize(int count)
+{
+    Strut strut = {};
+    strut.valid = false;
+    struts.resize(count > 0 ? count : 0, strut);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// set endpoints and radius of a strut
+///////////////////////////////////////////////////////////////////////////////
+void StrutCache::set(int index, const vec3& p1, const vec3& p2, float radius)
+{
+    Strut& strut = struts[index];
+    if(strut.valid && strut.radius == radius && strut.p1 == p1 && strut.p2 == p2)
+        return;
+
+    strut.p1 = p1;
+    strut.p2 = p2;
+    strut.radius = radius;
+    computeMatrix(strut);
+    strut.valid = true;
+    ++updateCount;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// compute the matrix of a strut without trig
+// The rotation is the shortest arc from Z to the strut direction, the same
+// as rotating around (Z x direction), so the sector seam stays where
+// glRotated() about that axis put it.
+///////////////////////////////////////////////////////////////////////////////
+void StrutCache::computeMatrix(Strut& strut)
+{
+    const vec3 Z_AXIS(0, 0, 1);
+
+    vec3 d = strut.p2 - strut.p1;
+    strut.length = d.length();
+
+    // Z for a zero-length strut, it is scaled to nothing anyway
+    vec3 direction = strut.length > EPSILON ? d * (1.0f / strut.length) : Z_AXIS;
+    strut.rotation = quat::fromTo(Z_AXIS, direction);
+
+    strut.matrix = mat4::compose((strut.p1 + strut.p2) * 0.5f, strut.rotation,
+                                 vec3(strut.radius, strut.radius, strut.length));
+}
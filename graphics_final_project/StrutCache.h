@@ -0,0 +1,54 @@
+///////////////////////////////////////////////////////////////////////////////
+// StrutCache.h
+// ============
+// cached model matrices of struts between 2 points
+// Each matrix maps the unit cylinder (radius 1, height 1, centered at the
+// origin along Z) onto a strut: scale by radius/length, rotate Z to the
+// strut direction by the shortest arc and translate to the midpoint. set() keeps the endpoints
+// and recomputes the matrix only when they change, so a static lattice
+// computes them once and draws with glMultMatrixf() every frame.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef GEOMETRY_STRUT_CACHE_H
+#define GEOMETRY_STRUT_CACHE_H
+
+#include <vector>
+#include "Math3d.h"
+
+class StrutCache
+{
+public:
+    StrutCache(int count=0);
+
+    int getStrutCount() const               { return (int)struts.size(); }
+    void resize(int count);
+
+    // set endpoints and radius of a strut, recompute if any changed
+    void set(int index, const vec3& p1, const vec3& p2, float radius);
+
+    const mat4& getMatrix(int index) const  { return struts[index].matrix; }
+    float getLength(int index) const        { return struts[index].length; }
+    float getRadius(int index) const        { return struts[index].radius; }
+    vec3 getCenter(int index) const         { return (struts[index].p1 + struts[index].p2) * 0.5f; }
+    const quat& getRotation(int index) const    { return struts[index].rotation; }   // Z to direction
+    unsigned int getUpdateCount() const     { return updateCount; }    // # of matrices computed
+
+private:
+    struct Strut
+    {
+        mat4 matrix;                        // first for 16-byte alignment
+        quat rotation;
+        vec3 p1;
+        vec3 p2;
+        float radius;
+        float length;
+        bool valid;                         // false until the first set()
+    };
+
+    static void computeMatrix(Strut& strut);
+
+    std::vector<Strut> struts;
+    unsigned int updateCount;
+};
+
+#endif
@@ -13,9 +13,18 @@ float M_PI = 3.1415926535;
 #include <iomanip>
 #include <fstream>
 #include <cmath>
+#include <tuple>
+#include <algorithm>
 #include "Bmp.h"
 #include "Cylinder.h"
 #include "Icosphere.h"
+#include "MeshRegistry.h"
+#include "LodChain.h"
+#include "DetailController.h"
+#include "StrutCache.h"
+#include "InstanceBatch.h"
+#include "BakedScene.h"
+#include "RenderQueue.h"
 
 // GLUT CALLBACK functions
 void displayCB();
@@ -45,6 +54,26 @@ const float CAMERA_DISTANCE = 4.0f;
 const int   TEXT_WIDTH      = 8;
 const int   TEXT_HEIGHT     = 13;
 
+// nodes and struts of the model
+const int   NODE_COUNT      = 5;
+const int   STRUT_COUNT     = 8;
+const float NODE_RADIUS     = 0.069f;
+const float STRUT_RADIUS    = 0.067f;
+const float NODES[NODE_COUNT][3] = { {0, 0, 0}, {0, 1, 1}, {0, 0, 1}, {1, 0, 1}, {1, 1, 1} };
+const int   STRUTS[STRUT_COUNT][2] = { {0, 1}, {1, 2}, {0, 2}, {2, 3}, {0, 3}, {3, 4}, {0, 4}, {1, 4} };  // node indices
+const float NODE_COLOR[4]   = {1, 0, 0, 1};
+const float STRUT_COLOR[4]  = {1, 1, 1, 1};
+
+// level of detail, finest first
+// a level is used while the projected radius is at least its # of pixels
+const int   SPHERE_LOD_COUNT = 5;
+const int   STRUT_LOD_COUNT  = 4;
+const float SPHERE_LOD_PIXELS[SPHERE_LOD_COUNT]     = {64, 24, 8, 3, 0};
+const int   SPHERE_LOD_SUBDIVISIONS[SPHERE_LOD_COUNT] = {5, 4, 3, 2, 1};
+const float STRUT_LOD_PIXELS[STRUT_LOD_COUNT]       = {24, 12, 6, 0};
+const int   STRUT_LOD_SECTORS[STRUT_LOD_COUNT]      = {70, 36, 18, 8};
+const float FRAME_TIME_TARGET = 16.0f;     // ms per frame, tessellation is coarsened above it
+
 
 // global variables
 void *font = GLUT_BITMAP_8_BY_13;
@@ -62,15 +91,22 @@ GLuint texId;
 int imageWidth;
 int imageHeight;
 
-// cylinder: min sectors = 3, min stacks = 1
-Cylinder cylinder1(0.069f, 0.069f, 1.4f, 70, 8, false); // baseRadius, topRadius, height, sectors, stacks, flat shading
-Cylinder cylinder2(0.069f, 0.069f, 2.2f, 70, 8, false);        // baseRadius, topRadius, height, sectors, stacks, smooth(default)
-Cylinder cylinder3(0.069f, 0.069f, 2.0f, 70, 8, false);        // baseRadius, topRadius, height, sectors, stacks, smooth(default)
-Cylinder cylinder4(0.069f, 0.069f, 2.2f, 70, 8, false);        // baseRadius, topRadius, height, sectors, stacks, smooth(default)
-Cylinder cylinder5(0.069f, 0.069f, 1.0f, 70, 8, false);        // baseRadius, topRadius, height, sectors, stacks, smooth(default)
-int subdivision = 5;
-Icosphere sphere(0.050601, subdivision, false);    // radius, subdivision, smooth
-Icosphere sphere2(0.069f, subdivision, false);    // radius, subdivision, smooth
+// prebuilt levels of nodes and struts, and the current level of each instance
+IcosphereInstance sphereLods[SPHERE_LOD_COUNT];
+CylinderInstance strutLods[STRUT_LOD_COUNT];
+LodChain sphereChain;
+LodChain strutChain;
+int nodeLevels[NODE_COUNT];
+int strutLevels[STRUT_COUNT];
+StrutCache strutCache(STRUT_COUNT);
+RenderQueue renderQueue;                        // nodes and struts sorted by mesh
+BakedScene bakedScenes[SPHERE_LOD_COUNT][STRUT_LOD_COUNT];     // all nodes and struts in 1 buffer, per pair of levels
+unsigned int sceneUpdates[SPHERE_LOD_COUNT][STRUT_LOD_COUNT];  // strut updates when each scene was filled
+int sceneSphereLevel;                           // levels of the baked scene drawn last
+int sceneStrutLevel;
+bool sceneBaked;                                // draw bakedScenes instead of renderQueue
+DetailController detailController;
+bool infoVisible;
 
 ///////////////////////////////////////////////////////////////////////////////
 int main(int argc, char **argv)
@@ -233,11 +269,37 @@ bool initSharedMem()
     cameraDistance = CAMERA_DISTANCE;
 
     drawMode = 0; // 0:fill, 1: wireframe, 2:points
+    infoVisible = false;
+    sceneBaked = true;              // the lattice is static
+    sceneSphereLevel = sceneStrutLevel = 0;
+    for(int i = 0; i < SPHERE_LOD_COUNT; ++i)
+        for(int j = 0; j < STRUT_LOD_COUNT; ++j)
+            sceneUpdates[i][j] = 0;
+
+    // build all levels now, not on the first frame they are selected
+    for(int i = 0; i < SPHERE_LOD_COUNT; ++i)
+    {
+        sphereLods[i].setRadius(NODE_RADIUS);
+        sphereLods[i].setSubdivision(SPHERE_LOD_SUBDIVISIONS[i]);
+        sphereLods[i].setSmooth(false);
+        sphereLods[i].commit();
+        sphereChain.addLevel(SPHERE_LOD_PIXELS[i], sphereLods[i].getTriangleCount());
+    }
+    for(int i = 0; i < STRUT_LOD_COUNT; ++i)
+    {
+        // height is set per strut, it is scale only
+        strutLods[i].set(STRUT_RADIUS, STRUT_RADIUS, 1.0f, STRUT_LOD_SECTORS[i], 1, true);
+        strutLods[i].setStrut(true);
+        strutLods[i].commit();
+        strutChain.addLevel(STRUT_LOD_PIXELS[i], strutLods[i].getTriangleCount());
+    }
+    for(int i = 0; i < NODE_COUNT; ++i)
+        nodeLevels[i] = -1;     // not selected yet
+    for(int i = 0; i < STRUT_COUNT; ++i)
+        strutLevels[i] = -1;
 
-    //cylinder1.setBaseRadius(2);
-    //cylinder1.setTopRadius(2);
-    //cylinder1.setHeight(2);
-    cylinder2.printSelf();
+    detailController.setTarget(FRAME_TIME_TARGET);
+    detailController.setMaxBias(SPHERE_LOD_COUNT > STRUT_LOD_COUNT ? SPHERE_LOD_COUNT - 1 : STRUT_LOD_COUNT - 1);
 
     return true;
 }
@@ -379,35 +441,50 @@ void showInfo()
     std::stringstream ss;
     ss << std::fixed << std::setprecision(3);
 
-    ss << "Base Radius: " << cylinder2.getBaseRadius() << std::ends;
+    ss << "Sphere Triangles: " << sphereChain.getTrianglesDrawn() << " / " << sphereChain.getTrianglesFull() << std::ends;
     drawString(ss.str().c_str(), 1, screenHeight-TEXT_HEIGHT, color, font);
     ss.str("");
 
-    ss << "Top Radius: " << cylinder2.getTopRadius() << std::ends;
+    ss << "Strut Triangles: " << strutChain.getTrianglesDrawn() << " / " << strutChain.getTrianglesFull() << std::ends;
     drawString(ss.str().c_str(), 1, screenHeight-(2*TEXT_HEIGHT), color, font);
     ss.str("");
 
-    ss << "Height: " << cylinder2.getHeight() << std::ends;
+    ss << "Triangles Saved: " << (sphereChain.getTrianglesSaved() + strutChain.getTrianglesSaved()) << std::ends;
     drawString(ss.str().c_str(), 1, screenHeight-(3*TEXT_HEIGHT), color, font);
     ss.str("");
 
-    ss << "Sector Count: " << cylinder2.getSectorCount() << std::ends;
+    if(sceneBaked)
+    {
+        const BakedScene& scene = bakedScenes[sceneSphereLevel][sceneStrutLevel];
+        ss << "Draw Calls: 1 (baked in " << scene.getBakeTime() << " ms, "
+           << scene.getVertexSize() / 1024 << " KB vertices, "
+           << scene.getIndexSize() / 1024 << " KB indices)" << std::ends;
+    }
+    else
+    {
+        const RenderQueue::Stats& stats = renderQueue.getStats();
+        ss << "Draw Calls: " << stats.drawCallCount << (InstanceBatch::isInstancingAvailable() ? " (instanced)" : " (batched)")
+           << ", Mesh Setups: " << stats.meshSetupCount << ", State Changes: " << stats.stateChangeCount
+           << " (" << stats.itemCount << " items)" << std::ends;
+    }
     drawString(ss.str().c_str(), 1, screenHeight-(4*TEXT_HEIGHT), color, font);
     ss.str("");
 
-    ss << "Stack Count: " << cylinder2.getStackCount() << std::ends;
+    ss << "Frame Time: " << detailController.getAverage() << " ms (GPU " << detailController.getGpuTime()
+       << " ms, target " << detailController.getTarget() << " ms)" << std::ends;
     drawString(ss.str().c_str(), 1, screenHeight-(5*TEXT_HEIGHT), color, font);
     ss.str("");
 
-    ss << "Vertex Count: " << cylinder2.getVertexCount() << std::ends;
+    // finest tessellation drawn in the last frame
+    int sphereLevel = sphereChain.getFinestDrawn();
+    int strutLevel = strutChain.getFinestDrawn();
+    ss << "Tessellation: subdivision " << (sphereLevel < 0 ? 0 : SPHERE_LOD_SUBDIVISIONS[sphereLevel])
+       << ", " << (strutLevel < 0 ? 0 : STRUT_LOD_SECTORS[strutLevel]) << " sectors"
+       << " (bias +" << detailController.getBias() << ")" << std::ends;
     drawString(ss.str().c_str(), 1, screenHeight-(6*TEXT_HEIGHT), color, font);
     ss.str("");
 
-    ss << "Index Count: " << cylinder2.getIndexCount() << std::ends;
-    drawString(ss.str().c_str(), 1, screenHeight-(7*TEXT_HEIGHT), color, font);
-    ss.str("");
-
-    drawString("Press SPACE to change sectors/stacks.", 1, 1, color, font);
+    drawString("Press B to toggle baking, I to hide info.", 1, 1, color, font);
 
     // unset floating format
     ss << std::resetiosflags(std::ios_base::fixed | std::ios_base::floatfield);
@@ -460,108 +537,91 @@ void toPerspective()
     glLoadIdentity();
 }
 
-/*scalex - scaling of sphere around x-axis
-  scaley - scaling of sphere around y-axis
-  r - radius of sphere
- */
-void drawHalfSphere(int scaley, int scalex, GLfloat r) {
-  int i, j;
-  GLfloat v[scalex*scaley][3];
-
-  for (i=0; i<scalex; ++i) {
-    for (j=0; j<scaley; ++j) {
-      v[i*scaley+j][0]=r*cos(j*2*M_PI/scaley)*cos(i*M_PI/(2*scalex));
-      v[i*scaley+j][1]=r*sin(i*M_PI/(2*scalex));
-      v[i*scaley+j][2]=r*sin(j*2*M_PI/scaley)*cos(i*M_PI/(2*scalex));
-    }
-  }
-
-  glBegin(GL_QUADS);
-    for (i=0; i<scalex-1; ++i) {
-      for (j=0; j<scaley; ++j) {
-        glVertex3fv(v[i*scaley+j]);
-        glVertex3fv(v[i*scaley+(j+1)%scaley]);
-        glVertex3fv(v[(i+1)*scaley+(j+1)%scaley]);
-        glVertex3fv(v[(i+1)*scaley+j]);
-      }
-    }
-  glEnd();
-}
-
-std::vector<float> cross(std::vector<float> a, std::vector<float> b)
+///////////////////////////////////////////////////////////////////////////////
+// queue a strut with the mesh of the level of its projected radius,
+// lodLevel is the current level of the strut (-1 if new)
+// In baked mode the level is only selected, see drawBakedScene().
+// The unit cylinder is scaled by radius/length and rotated from Z to the
+// strut direction, as cached in strutCache.
+///////////////////////////////////////////////////////////////////////////////
+void addStrut(int index, int& lodLevel, const mat4& modelview, const mat4& projection, int viewportHeight)
 {
-    std::vector<float> return_vec;
-    return_vec.push_back(a[1]*b[2] - a[2]*b[1]);
-    return_vec.push_back(a[2]*b[0] - a[0]*b[2]);
-    return_vec.push_back(a[0]*b[1] - a[1]*b[0]);
-    return return_vec;
+    vec3 center = strutCache.getCenter(index);
+    float radius = strutCache.getRadius(index);
+    lodLevel = strutChain.select(LodChain::computeScreenRadius(radius, center, modelview, projection, viewportHeight),
+                                 lodLevel);
+    if(sceneBaked)
+        return;
+
+    int level = strutChain.getBiased(lodLevel, detailController.getBias());
+    strutChain.addDrawn(level);
+    vec3 scale(radius, radius, strutCache.getLength(index));
+    renderQueue.add(*strutLods[level].getMesh(), center, strutCache.getRotation(index), scale, STRUT_COLOR);
 }
 
-void draw_cylinder(GLfloat radius,
-                   GLfloat height,
-                   GLubyte R,
-                   GLubyte G,
-                   GLubyte B)
+///////////////////////////////////////////////////////////////////////////////
+// queue a node with the mesh of the level of its projected radius, same as
+// addStrut()
+///////////////////////////////////////////////////////////////////////////////
+void addNode(const vec3& position, float radius, int& lodLevel, const mat4& modelview, const mat4& projection,
+             int viewportHeight)
 {
-    GLfloat x              = 0.0;
-    GLfloat y              = 0.0;
-    GLfloat angle          = 0.0;
-    GLfloat angle_stepsize = 0.1;
-
-    /** Draw the tube */
-    glColor3d(R, G, B);
-    glBegin(GL_QUAD_STRIP);
-    angle = 0.0;
-        while( angle < 2*M_PI ) {
-            x = radius * cos(angle);
-            y = radius * sin(angle);
-            glVertex3f(x, y , height);
-            glVertex3f(x, y , 0.0);
-            angle = angle + angle_stepsize;
-        }
-        glVertex3f(radius, 0.0, height);
-        glVertex3f(radius, 0.0, 0.0);
-    glEnd();
-
-    /** Draw the circle on top of cylinder */
-    glColor3d(R, G, B);
-    glBegin(GL_POLYGON);
-    angle = 0.0;
-        while( angle < 2*M_PI )
-        {
-            x = radius * cos(angle);
-            y = radius * sin(angle);
-            glVertex3f(x, y , height);
-            angle = angle + angle_stepsize;
-        }
-        glVertex3f(radius, 0.0, height);
-    glEnd();
+    lodLevel = sphereChain.select(LodChain::computeScreenRadius(radius, position, modelview, projection, viewportHeight),
+                                  lodLevel);
+    if(sceneBaked)
+        return;
+
+    int level = sphereChain.getBiased(lodLevel, detailController.getBias());
+    sphereChain.addDrawn(level);
+    vec3 scale(radius, radius, radius);
+    renderQueue.add(*sphereLods[level].getMesh(), position, quat(), scale, NODE_COLOR);
 }
 
-void cylinder_between(float x1, float y1, float z1, float x2, float y2, float z2, float rad1, float rad2)
+///////////////////////////////////////////////////////////////////////////////
+// draw all nodes and struts with one call
+// A baked scene has one level per chain: the finest level selected by any
+// node or any strut, plus the detail bias. The scene of each pair of levels
+// is filled and baked the first time it is drawn and then kept, so zooming
+// or a bias step switches scenes instead of re-baking. It is filled again
+// only if a strut moved since, and re-baked if that changed a part.
+///////////////////////////////////////////////////////////////////////////////
+void drawBakedScene()
 {
-    std::vector<float> v = {x2-x1, y2-y1, z2-z1};
-    float height = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
-    std::vector<float> axis;
-    if(hypot(v[0], v[1]) < 0.001)
+    int sphereLevel = SPHERE_LOD_COUNT - 1;
+    for(int i = 0; i < NODE_COUNT; ++i)
+        sphereLevel = std::min(sphereLevel, nodeLevels[i]);
+    sphereLevel = sphereChain.getBiased(sphereLevel, detailController.getBias());
+
+    int strutLevel = STRUT_LOD_COUNT - 1;
+    for(int i = 0; i < STRUT_COUNT; ++i)
+        strutLevel = std::min(strutLevel, strutLevels[i]);
+    strutLevel = strutChain.getBiased(strutLevel, detailController.getBias());
+
+    BakedScene& scene = bakedScenes[sphereLevel][strutLevel];
+    unsigned int& updates = sceneUpdates[sphereLevel][strutLevel];
+    if(!scene.isBaked() || updates != strutCache.getUpdateCount())
     {
-        axis.push_back(1);
-        axis.push_back(0);
-        axis.push_back(0);
-    }
-    else{
-        axis = cross(v, {0, 0, 1});
+        scene.clear();
+        for(int i = 0; i < STRUT_COUNT; ++i)
+        {
+            float radius = strutCache.getRadius(i);
+            vec3 scale(radius, radius, strutCache.getLength(i));
+            scene.add(strutLods[strutLevel].getMesh(), strutCache.getCenter(i), strutCache.getRotation(i), scale,
+                      STRUT_COLOR);
+        }
+        vec3 nodeScale(NODE_RADIUS, NODE_RADIUS, NODE_RADIUS);
+        for(int i = 0; i < NODE_COUNT; ++i)
+            scene.add(sphereLods[sphereLevel].getMesh(), vec3(NODES[i]), quat(), nodeScale, NODE_COLOR);
+        updates = strutCache.getUpdateCount();
     }
-    float angle = -atan2(hypot(v[0], v[1]), v[2])*180/M_PI;
-    
-    glPushMatrix();
-    glTranslated(x1, y1, z1);
-    glRotated(angle, axis[0], axis[1], axis[2]);
-//    Cylinder cylinderx(rad1, rad2, height, 70, 8, false); // baseRadius, topRadius, height, sectors, stacks, flat shading
-//    cylinderx.draw();
-    draw_cylinder(rad1, height, 255, 255, 255);
-//    glutSolidCone(rad1, height, 32, 16);
-    glPopMatrix();
+    scene.draw();
+    sceneSphereLevel = sphereLevel;
+    sceneStrutLevel = strutLevel;
+
+    for(int i = 0; i < NODE_COUNT; ++i)
+        sphereChain.addDrawn(sphereLevel);
+    for(int i = 0; i < STRUT_COUNT; ++i)
+        strutChain.addDrawn(strutLevel);
 }
 
 //=============================================================================
@@ -570,6 +630,8 @@ void cylinder_between(float x1, float y1, float z1, float x2, float y2, float z2
 
 void displayCB()
 {
+    detailController.beginFrame();
+
     // clear buffer
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
@@ -603,48 +665,33 @@ void displayCB()
     glRotatef(cameraAngleX, 1, 0, 0);
     glRotatef(cameraAngleY, 0, 1, 0);
     
-    cylinder_between(0, 0, 0, 0, 1, 1, 0.067, .070);
-    cylinder_between(0, 1, 1, 0, 0, 1, 0.067, .070);
-    cylinder_between(0, 0, 0, 0, 0, 1, 0.067, .070);
-    cylinder_between(0, 0, 1, 1, 0, 1, 0.067, .070);
-    cylinder_between(0, 0, 0, 1, 0, 1, 0.067, .070);
-    cylinder_between(1, 0, 1, 1, 1, 1, 0.067, .070);
-    cylinder_between(0, 0, 0, 1, 1, 1, 0.067, .070);
-    cylinder_between(0, 1, 1, 1, 1, 1, 0.067, .070);
-    
-    glPushMatrix();
-    glColor3f(1, 0, 0);
-    sphere2.draw();
-    glColor3f(1, 1, 1);
-    glPopMatrix();
-    
-    glPushMatrix();
-    glTranslated(0, 1, 1);
-    glColor3f(1, 0, 0);
-    sphere2.draw();
-    glColor3f(1, 1, 1);
-    glPopMatrix();
-    
-    glPushMatrix();
-    glTranslated(0, 0, 1);
-    glColor3f(1, 0, 0);
-    sphere2.draw();
-    glColor3f(1, 1, 1);
-    glPopMatrix();
-    
-    glPushMatrix();
-    glTranslated(1, 0, 1);
-    glColor3f(1, 0, 0);
-    sphere2.draw();
-    glColor3f(1, 1, 1);
-    glPopMatrix();
-    
-    glPushMatrix();
-    glTranslated(1, 1, 1);
-    glColor3f(1, 0, 0);
-    sphere2.draw();
-    glColor3f(1, 1, 1);
-    glPopMatrix();
+    // pick the level of each instance from its projected radius, with the
+    // matrices read once for all instances
+    sphereChain.resetStats();
+    strutChain.resetStats();
+    mat4 modelview, projection;
+    GLint viewport[4];
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview.data());
+    glGetFloatv(GL_PROJECTION_MATRIX, projection.data());
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    // queue instances, sorted by mesh at submit and drawn with one call or
+    // one array setup per mesh, or draw the baked scene of the finest level
+    // only struts whose endpoints moved recompute their transform
+    renderQueue.clear();
+
+    for(int i = 0; i < STRUT_COUNT; ++i)
+    {
+        strutCache.set(i, vec3(NODES[STRUTS[i][0]]), vec3(NODES[STRUTS[i][1]]), STRUT_RADIUS);
+        addStrut(i, strutLevels[i], modelview, projection, viewport[3]);
+    }
+    for(int i = 0; i < NODE_COUNT; ++i)
+        addNode(vec3(NODES[i]), NODE_RADIUS, nodeLevels[i], modelview, projection, viewport[3]);
+
+    if(sceneBaked)
+        drawBakedScene();
+    else
+        renderQueue.submit();
     
     
     ////////////////////////
@@ -740,10 +787,14 @@ void displayCB()
 
     glBindTexture(GL_TEXTURE_2D, 0);
 
-//    showInfo();     // print max range of glDrawRangeElements
+    if(infoVisible)
+        showInfo();     // print LOD triangle counts
 
     glPopMatrix();
 
+    // GPU time is read back a frame late, so the pipeline is not stalled
+    detailController.endFrame();
+
     glutSwapBuffers();
 }
 
@@ -830,19 +881,15 @@ void keyboardCB(unsigned char key, int x, int y)
         }
         break;
 
-    case ' ':
-    {
-        int count = cylinder1.getSectorCount();
-        if(count < 36)
-            count += 4;
-        else
-            count = 4;
-        cylinder1.setSectorCount(count);
-        cylinder2.setSectorCount(count);
-        cylinder1.setStackCount(count/4);
-        cylinder2.setStackCount(count/4);
+    case 'b': // toggle baked scene and instance batches
+    case 'B':
+        sceneBaked = !sceneBaked;
+        break;
+
+    case 'i': // toggle info messages
+    case 'I':
+        infoVisible = !infoVisible;
         break;
-    }
 
     default:
         ;